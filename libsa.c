@@ -0,0 +1,6366 @@
+#define _GNU_SOURCE
+#define _FILE_OFFSET_BITS 64
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+#include "libsa.h"
+
+// Identificação do formato gravada no boot record
+#define SA_MAGIC "SAFS"
+#define SA_VERSION 5
+
+// Define a estrutura do boot record e entrada do diretório
+typedef struct __attribute__((packed)) {
+    char magic[4];                     // 4 bytes: SA_MAGIC
+    unsigned int version;              // 4 bytes: SA_VERSION
+    unsigned int bytes_por_sector;     // 4 bytes
+    unsigned int sectors_per_block;    // 4 bytes
+    unsigned int reserved_sectors;     // 4 bytes
+    unsigned int dir_sectors;          // 4 bytes
+    unsigned int data_sectors;         // 4 bytes
+    unsigned int bitmap_sectors;       // 4 bytes
+    unsigned int total_sectors;        // 4 bytes
+    unsigned int file_count;           // 4 bytes
+    unsigned int first_free_sector;    // 4 bytes: primeiro setor da área de dados
+    unsigned int dir_entries;          // 4 bytes: capacidade do diretório
+    unsigned int journal_sectors;      // 4 bytes: área do journal, entre o bitmap e os dados
+    unsigned int free_sectors;         // 4 bytes: setores livres na área de dados
+    unsigned int largest_free_run;     // 4 bytes: maior faixa de setores livres contíguos
+    unsigned int alloc_hint;           // 4 bytes: onde a próxima alocação next-fit começa a procurar
+    unsigned int free_state;           // 4 bytes: RESUMO_VALIDO se os três campos acima refletem o bitmap
+    char reserved[60];                 // 60 bytes reservados (total: 128 bytes)
+} BootRecord;
+
+// Resumo do espaço livre gravado por completo (outro valor, inclusive 0 em
+// imagens anteriores, faz a montagem recalculá-lo a partir do bitmap)
+#define RESUMO_VALIDO 0x4F4D5352u      // "RSMO"
+#define RESUMO_SUJO   0u
+
+// Faixa contígua de setores ocupada por um arquivo
+typedef struct __attribute__((packed)) {
+    unsigned int start;        // 4 bytes: primeiro setor da faixa
+    unsigned int count;        // 4 bytes: quantidade de setores
+} FileExtent;
+
+// Extents guardados na própria entrada do diretório
+#define INLINE_EXTENTS 3
+// Limite de extents por arquivo (extent_count tem 16 bits)
+#define MAX_EXTENTS 65535
+
+typedef struct __attribute__((packed)) {
+    unsigned char status;      // 1 byte: 0x00 para válido, 0xFF para deletado
+    char filename[12];         // 12 bytes para o nome do arquivo
+    char extension[4];         // 4 bytes para a extensão
+    unsigned char attributes;  // 1 byte para atributos
+    unsigned int first_sector; // 4 bytes: setor inicial do arquivo (início do primeiro extent)
+    unsigned int file_size;    // 4 bytes: tamanho do arquivo em bytes
+    unsigned short extent_count;   // 2 bytes: quantidade total de extents
+    unsigned int overflow_sector;  // 4 bytes: primeiro bloco de extents extras (0 = nenhum)
+    FileExtent extents[INLINE_EXTENTS]; // 24 bytes: primeiros extents do arquivo
+    unsigned int tail_sector;      // 4 bytes: setor de fragmentos com o fim do arquivo (ATRIB_CAUDA)
+    unsigned short tail_offset;    // 2 bytes: posição da cauda no setor, em bytes
+    unsigned short tail_length;    // 2 bytes: tamanho da cauda em bytes (total: 64 bytes)
+} DirEntry;
+
+// Atributos de armazenamento (os demais bits de attributes continuam livres)
+#define ATRIB_CAUDA    0x20    // últimos file_size % setor bytes em um setor de fragmentos
+#define ATRIB_EMBUTIDO 0x40    // dados inteiros na entrada, a partir de overflow_sector
+#define ATRIB_COMPRIMIDO 0x10  // extents com a tabela de blocos e os blocos comprimidos
+
+// Bytes originais por bloco de um arquivo comprimido (o último pode ser menor)
+#define BLOCO_COMPRESSAO (64 << 10)
+
+// Bytes de dados que cabem na entrada de um arquivo embutido: de
+// overflow_sector até o fim da entrada, sem extents nem cauda
+#define EMBUTIDO_MAX (sizeof(DirEntry) - offsetof(DirEntry, overflow_sector))
+
+static inline unsigned char *dados_embutidos(DirEntry *entry) {
+    return (unsigned char *)&entry->overflow_sector;
+}
+
+// Cabeçalho de um bloco de extents (um setor), seguido de FileExtent[count]
+typedef struct __attribute__((packed)) {
+    unsigned int next_sector;  // 4 bytes: próximo bloco de extents (0 = último)
+    unsigned int count;        // 4 bytes: extents neste bloco
+} ExtentBlockHeader;
+
+// Offset em bytes do setor 'sector' (64 bits, para imagens grandes)
+static inline off_t offset_setor(const BootRecord *br, uint64_t sector) {
+    return (off_t)(sector * br->bytes_por_sector);
+}
+
+// Journal de metadados: duas metades alternadas, cada uma com os setores de
+// cabeçalho seguidos das imagens dos setores de metadados da transação
+#define JOURNAL_MAGIC "SAJL"
+
+// Cabeçalho de uma transação, seguido de unsigned int setores[count] (que
+// pode continuar nos setores seguintes)
+typedef struct __attribute__((packed)) {
+    char magic[4];             // 4 bytes: JOURNAL_MAGIC
+    unsigned int count;        // 4 bytes: setores registrados na transação
+    uint64_t seq;              // 8 bytes: número de sequência da transação
+    unsigned int checksum;     // 4 bytes: FNV-1a do cabeçalho (com checksum 0) e das imagens
+    unsigned int reserved;     // 4 bytes reservados (total: 24 bytes)
+} JournalHeader;
+
+// Setores ocupados pelo cabeçalho de uma transação com 'count' imagens
+static inline uint64_t cabecalho_journal(uint64_t bps, uint64_t count) {
+    return (sizeof(JournalHeader) + count * sizeof(unsigned int) + bps - 1) / bps;
+}
+
+// Maior transação possível: todos os setores de metadados que mudam (o
+// setor do boot record, o diretório e o bitmap) de uma vez
+static inline uint64_t capacidade_journal(uint64_t dir_sectors, uint64_t bitmap_sectors) {
+    return 1 + dir_sectors + bitmap_sectors;
+}
+
+// ---------------------------------------------------------------------------
+// Estatísticas de operações
+//
+// Cada tipo de operação acumula contadores e um histograma de latência. A
+// operação em andamento em cada thread é apontada por estat_corrente, de modo
+// que as primitivas de E/S, o alocador e o índice do diretório contam sem
+// receber o volume; sem operação em andamento (montagem, formatação) nada é
+// contado. Os contadores somados por threads de transferência usam adições
+// atômicas relaxadas.
+// ---------------------------------------------------------------------------
+
+// Tipos de operação instrumentados
+#define OP_IMPORTACAO    0
+#define OP_EXPORTACAO    1
+#define OP_REMOCAO       2
+#define OP_LISTAGEM      3
+#define OP_LEITURA       4     // sa_ler em arquivo aberto
+#define OP_ESCRITA       5     // sa_escrever, sa_anexar e sa_truncar
+#define OP_SINCRONIZACAO 6     // sincronizações fora de outra operação
+#define OP_TIPOS         7
+
+// Latência: a faixa i cobre [2^i, 2^(i+1)) µs (a primeira inclui < 1 µs)
+#define HIST_FAIXAS 32
+
+typedef struct {
+    uint64_t ops;              // operações concluídas com sucesso
+    uint64_t falhas;           // operações que falharam
+    uint64_t bytes_lidos;      // bytes lidos da imagem
+    uint64_t bytes_escritos;   // bytes escritos na imagem
+    uint64_t chamadas;         // chamadas de sistema de E/S (imagem e arquivos externos)
+    uint64_t reposicionamentos;// acessos à imagem fora da sequência do anterior
+    uint64_t syncs;            // fdatasync
+    uint64_t setores_alocados;
+    uint64_t setores_liberados;
+    uint64_t sondagens_dir;    // posições da tabela de nomes visitadas
+    uint64_t passos_alocador;  // nós do índice de faixas livres visitados
+    uint64_t ns_total;         // tempo das operações
+    uint64_t ns_alocacao;      // ... reservando setores
+    uint64_t ns_dados;         // ... transferindo dados
+    uint64_t ns_metadados;     // ... gravando metadados (journal e lugar definitivo)
+    uint64_t histograma[HIST_FAIXAS];
+} EstatOperacao;
+
+static const char *nomes_operacoes[OP_TIPOS] = {"importacao", "exportacao", "remocao", "listagem",
+                                               "leitura", "escrita", "sincronizacao"};
+
+static __thread EstatOperacao *estat_corrente;  // operação em andamento nesta thread
+static __thread off_t estat_proximo_off = -1;   // fim do último acesso desta thread à imagem
+
+static inline uint64_t agora_ns(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * 1000000000ULL + (uint64_t)t.tv_nsec;
+}
+
+static inline void estat_somar(uint64_t *contador, uint64_t n) {
+    __atomic_fetch_add(contador, n, __ATOMIC_RELAXED);
+}
+
+// Soma n ao campo 'campo' da operação corrente, se houver
+#define ESTAT(campo, n) do { if (estat_corrente) estat_somar(&estat_corrente->campo, (n)); } while (0)
+
+// Chamada de E/S posicional de 'len' bytes à imagem em 'off'
+static inline void estat_acesso(off_t off, size_t len, int escrita) {
+    EstatOperacao *s = estat_corrente;
+    if (!s) return;
+    estat_somar(&s->chamadas, 1);
+    estat_somar(escrita ? &s->bytes_escritos : &s->bytes_lidos, len);
+    if (off != estat_proximo_off) estat_somar(&s->reposicionamentos, 1);
+    estat_proximo_off = off + (off_t)len;
+}
+
+// fdatasync contado na operação corrente
+static inline int sincronizar_fd(int fd) {
+    if (estat_corrente) {
+        estat_somar(&estat_corrente->chamadas, 1);
+        estat_somar(&estat_corrente->syncs, 1);
+    }
+    return fdatasync(fd);
+}
+
+// Operação medida: contadores em 's' até estat_concluir ou estat_pausar
+typedef struct {
+    EstatOperacao *s;
+    EstatOperacao *anterior;   // operação corrente antes desta (restaurada ao fim)
+    uint64_t inicio;
+} EstatEscopo;
+
+// Inicia (ou retoma, com 'decorrido' ns já gastos) uma operação medida
+static void estat_iniciar(EstatEscopo *e, EstatOperacao *s, uint64_t decorrido) {
+    e->s = s;
+    e->anterior = estat_corrente;
+    e->inicio = agora_ns() - decorrido;
+    estat_corrente = s;
+}
+
+// Interrompe a medição sem registrar a operação; retorna o tempo decorrido
+static uint64_t estat_pausar(EstatEscopo *e) {
+    estat_corrente = e->anterior;
+    return agora_ns() - e->inicio;
+}
+
+// Registra a operação (resultado 0 = sucesso) e devolve o resultado
+static int estat_concluir(EstatEscopo *e, int resultado) {
+    uint64_t ns = estat_pausar(e);
+    EstatOperacao *s = e->s;
+    estat_somar(resultado == 0 ? &s->ops : &s->falhas, 1);
+    estat_somar(&s->ns_total, ns);
+    uint64_t us = ns / 1000;
+    int faixa = us ? 63 - __builtin_clzll(us) : 0;
+    estat_somar(&s->histograma[faixa < HIST_FAIXAS ? faixa : HIST_FAIXAS - 1], 1);
+    return resultado;
+}
+
+// Lê exatamente len bytes a partir de off (pread pode retornar menos)
+static int ler_em(int fd, void *buf, size_t len, off_t off) {
+    unsigned char *p = (unsigned char *)buf;
+    while (len > 0) {
+        ssize_t n = pread(fd, p, len, off);
+        estat_acesso(off, n > 0 ? (size_t)n : 0, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            if (n == 0) errno = EIO;
+            return -1;
+        }
+        p += n;
+        len -= n;
+        off += n;
+    }
+    return 0;
+}
+
+// Escreve exatamente len bytes a partir de off
+static int escrever_em(int fd, const void *buf, size_t len, off_t off) {
+    const unsigned char *p = (const unsigned char *)buf;
+    while (len > 0) {
+        ssize_t n = pwrite(fd, p, len, off);
+        estat_acesso(off, n > 0 ? (size_t)n : 0, 1);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) return -1;
+        p += n;
+        len -= n;
+        off += n;
+    }
+    return 0;
+}
+
+// Lê sequencialmente até len bytes; retorna menos apenas no fim do arquivo
+static ssize_t ler_sequencial(int fd, void *buf, size_t len) {
+    unsigned char *p = (unsigned char *)buf;
+    size_t total = 0;
+    while (total < len) {
+        ssize_t n = read(fd, p + total, len - total);
+        ESTAT(chamadas, 1);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) return -1;
+        if (n == 0) break;
+        total += n;
+    }
+    return (ssize_t)total;
+}
+
+// Escreve sequencialmente exatamente len bytes
+static int escrever_sequencial(int fd, const void *buf, size_t len) {
+    const unsigned char *p = (const unsigned char *)buf;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        ESTAT(chamadas, 1);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) return -1;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// Calcula o layout do disco a partir dos parâmetros de formatação
+static int calcular_geometria(const FormatParams *params, BootRecord *br) {
+    uint32_t bps = params->bytes_per_sector ? params->bytes_per_sector : BYTES_PER_SECTOR;
+    uint32_t spb = params->sectors_per_block ? params->sectors_per_block : SECTORS_PER_BLOCK;
+    uint32_t capacity = params->dir_capacity ? params->dir_capacity : DIR_CAPACITY;
+    uint64_t disk_size = params->disk_size ? params->disk_size : (uint64_t)TOTAL_SECTORS * BYTES_PER_SECTOR;
+
+    if (bps < 512 || bps > 65536 || (bps & (bps - 1)) != 0) {
+        printf("Erro: Bytes por setor deve ser potência de 2 entre 512 e 65536\n");
+        return -1;
+    }
+
+    uint64_t total = disk_size / bps;
+    if (total > UINT32_MAX) {
+        printf("Erro: Disco com setores demais (máximo %u)\n", UINT32_MAX);
+        return -1;
+    }
+
+    uint64_t dir_sectors = ((uint64_t)capacity * sizeof(DirEntry) + bps - 1) / bps;
+    if (total <= RESERVED_SECTORS + dir_sectors + 1) {
+        printf("Erro: Disco pequeno demais para a geometria informada\n");
+        return -1;
+    }
+
+    // O bitmap precisa de um bit por setor de dados
+    uint64_t remaining = total - RESERVED_SECTORS - dir_sectors;
+    uint64_t bits_per_sector = (uint64_t)bps * 8;
+    uint64_t bitmap_sectors = (remaining + bits_per_sector - 1) / bits_per_sector;
+
+    // O journal guarda duas transações, cada uma do tamanho da maior
+    // possível: nenhuma sincronização grava metadados fora dele
+    uint64_t capacidade = capacidade_journal(dir_sectors, bitmap_sectors);
+    uint64_t journal_sectors = 2 * (cabecalho_journal(bps, capacidade) + capacidade);
+    if (remaining <= bitmap_sectors + journal_sectors) {
+        printf("Erro: Disco pequeno demais para a geometria informada\n");
+        return -1;
+    }
+    remaining -= journal_sectors;
+    bitmap_sectors = (remaining + bits_per_sector - 1) / bits_per_sector;
+
+    // A área de dados começa em um limite de bloco: os setores que faltam
+    // entram como reservados, antes do diretório (o bitmap, calculado sem
+    // eles, fica no máximo com bits de sobra)
+    uint64_t reserved_sectors = RESERVED_SECTORS;
+    uint64_t inicio_dados = reserved_sectors + dir_sectors + bitmap_sectors + journal_sectors;
+    uint64_t padding = (spb - inicio_dados % spb) % spb;
+    if (remaining <= bitmap_sectors + padding) {
+        printf("Erro: Disco pequeno demais para a geometria informada\n");
+        return -1;
+    }
+    reserved_sectors += padding;
+    uint64_t data_sectors = remaining - bitmap_sectors - padding;
+
+    memset(br, 0, sizeof(BootRecord));
+    memcpy(br->magic, SA_MAGIC, sizeof(br->magic));
+    br->version = SA_VERSION;
+    br->bytes_por_sector = bps;
+    br->sectors_per_block = spb;
+    br->reserved_sectors = (unsigned int)reserved_sectors;
+    br->dir_sectors = (unsigned int)dir_sectors;
+    br->bitmap_sectors = (unsigned int)bitmap_sectors;
+    br->data_sectors = (unsigned int)data_sectors;
+    br->journal_sectors = (unsigned int)journal_sectors;
+    br->total_sectors = (unsigned int)(reserved_sectors + dir_sectors + bitmap_sectors + journal_sectors + data_sectors);
+    br->file_count = 0;
+    br->first_free_sector = (unsigned int)(reserved_sectors + dir_sectors + bitmap_sectors + journal_sectors);
+    br->dir_entries = (unsigned int)((dir_sectors * bps) / sizeof(DirEntry));
+    br->free_sectors = (unsigned int)data_sectors;
+    br->largest_free_run = (unsigned int)data_sectors;
+    br->alloc_hint = br->first_free_sector;
+    br->free_state = RESUMO_VALIDO;
+    return 0;
+}
+
+// Cria a imagem com o tamanho final por ftruncate e grava boot record,
+// diretório e bitmap com uma única escrita. A área de dados não precisa
+// estar zerada: só setores marcados no bitmap são lidos, e o último setor
+// parcial de cada arquivo é completado com zeros na gravação.
+int formatar_disco(const char *disk_filename, const FormatParams *params) {
+    BootRecord br;
+    if (calcular_geometria(params, &br) != 0) {
+        return -1;
+    }
+
+    int fd = open(disk_filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror("Erro ao abrir o arquivo...");
+        return -1;
+    }
+
+    size_t bps = br.bytes_por_sector;
+    uint64_t image_size = (uint64_t)br.total_sectors * bps;
+    if (ftruncate(fd, (off_t)image_size) != 0) {
+        perror("Erro ao dimensionar a imagem do disco");
+        close(fd);
+        return -1;
+    }
+
+    // Boot record, diretório (entradas livres) e bitmap zerado em um só buffer;
+    // o journal fica no buraco do ftruncate, lido como zeros
+    size_t meta_size = ((size_t)br.reserved_sectors + br.dir_sectors + br.bitmap_sectors) * bps;
+    unsigned char *meta = (unsigned char *)calloc(meta_size, 1);
+    if (!meta) {
+        perror("Erro ao alocar memória para metadados");
+        close(fd);
+        return -1;
+    }
+    memcpy(meta, &br, sizeof(BootRecord));
+    DirEntry *dir = (DirEntry *)(meta + (size_t)br.reserved_sectors * bps);
+    for (unsigned int i = 0; i < br.dir_entries; i++) {
+        dir[i].status = 0xFF; // Marcar como livre
+    }
+    int r = escrever_em(fd, meta, meta_size, 0);
+    free(meta);
+    if (r != 0) {
+        printf("Erro ao escrever metadados: %s\n", strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    off_t data_off = offset_setor(&br, br.first_free_sector);
+    off_t data_len = (off_t)((uint64_t)br.data_sectors * bps);
+    if (params->area_dados == FORMATO_RESERVADO) {
+        // Reserva os blocos no host sem escrevê-los (extents não escritos)
+        if (fallocate(fd, 0, data_off, data_len) != 0) {
+            perror("Aviso: fallocate indisponível, área de dados mantida esparsa");
+        }
+    } else if (params->area_dados == FORMATO_ZERADO) {
+        // Zeros explícitos, em blocos de até 1 MB
+        size_t chunk_size = 1 << 20;
+        unsigned char *zeros = (unsigned char *)calloc(chunk_size, 1);
+        if (!zeros) {
+            perror("Erro ao alocar memória para inicializar a área de dados");
+            close(fd);
+            return -1;
+        }
+        uint64_t restante = (uint64_t)data_len;
+        off_t off = data_off;
+        while (restante > 0) {
+            size_t n = restante < chunk_size ? (size_t)restante : chunk_size;
+            if (escrever_em(fd, zeros, n, off) != 0) {
+                perror("Erro ao inicializar área de dados");
+                free(zeros);
+                close(fd);
+                return -1;
+            }
+            off += (off_t)n;
+            restante -= n;
+        }
+        free(zeros);
+    }
+
+    if (fdatasync(fd) != 0 || close(fd) != 0) {
+        perror("Erro ao gravar a imagem do disco");
+        return -1;
+    }
+    printf("Disco formatado com sucesso!\n");
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Alocador de setores
+//
+// O bitmap é percorrido 64 bits por vez (ctz/popcount) e as faixas livres
+// ficam em um índice ordenado, construído na montagem e atualizado a cada
+// alocação/liberação. O índice mantém duas árvores (treaps) sobre os mesmos
+// nós: uma ordenada por setor inicial, com o maior tamanho de cada subárvore,
+// e outra ordenada por (tamanho, início). Assim first-fit, next-fit e
+// best-fit são resolvidos em O(log n) sem varrer o bitmap.
+// ---------------------------------------------------------------------------
+
+typedef struct FreeExtent {
+    uint32_t start;                   // primeiro setor livre da faixa
+    uint32_t count;                   // quantidade de setores livres
+    uint32_t prio;                    // prioridade do treap
+    uint32_t max_count;               // maior count na subárvore por início
+    struct FreeExtent *left, *right;  // árvore ordenada por início
+    struct FreeExtent *sleft, *sright;// árvore ordenada por (count, start)
+} FreeExtent;
+
+typedef struct {
+    FreeExtent *by_start;             // raiz da árvore por início
+    FreeExtent *by_size;              // raiz da árvore por tamanho
+    uint32_t free_sectors;            // total de setores livres no índice
+    uint32_t extents;                 // quantidade de faixas livres
+    uint32_t next_hint;               // posição de partida do next-fit
+    uint32_t seed;                    // estado do gerador de prioridades
+} FreeIndex;
+
+// Lê a palavra de 64 bits 'w' do bitmap (bit i da palavra = setor 64*w + i)
+static inline uint64_t bitmap_palavra(const unsigned char *bitmap, size_t w) {
+    uint64_t v;
+    memcpy(&v, bitmap + w * 8, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap64(v);
+#endif
+    return v;
+}
+
+static inline void bitmap_gravar_palavra(unsigned char *bitmap, size_t w, uint64_t v) {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap64(v);
+#endif
+    memcpy(bitmap + w * 8, &v, sizeof(v));
+}
+
+// Máscara com 'n' bits a partir do bit 'b' (b + n <= 64)
+static inline uint64_t mascara_bits(unsigned b, unsigned n) {
+    return (n >= 64 ? ~0ULL : ((1ULL << n) - 1)) << b;
+}
+
+// Marca (ocupado = 1) ou libera (ocupado = 0) a faixa [inicio, inicio + n)
+static void bitmap_marcar(unsigned char *bitmap, uint32_t inicio, uint32_t n, int ocupado) {
+    uint64_t s = inicio;
+    uint64_t fim = (uint64_t)inicio + n;
+    while (s < fim) {
+        size_t w = s / 64;
+        unsigned b = s % 64;
+        unsigned len = (fim - s < 64 - b) ? (unsigned)(fim - s) : 64 - b;
+        uint64_t m = mascara_bits(b, len);
+        uint64_t v = bitmap_palavra(bitmap, w);
+        bitmap_gravar_palavra(bitmap, w, ocupado ? (v | m) : (v & ~m));
+        s += len;
+    }
+}
+
+// Próximo setor em [s, fim) cujo bit vale 'ocupado'; retorna fim se não houver
+static uint32_t bitmap_proximo(const unsigned char *bitmap, uint32_t s, uint32_t fim, int ocupado) {
+    while (s < fim) {
+        size_t w = s / 64;
+        unsigned b = s % 64;
+        uint64_t v = bitmap_palavra(bitmap, w);
+        if (!ocupado) v = ~v;
+        v &= ~0ULL << b;               // ignora bits anteriores a s
+        if (v) {
+            uint32_t achado = (uint32_t)(w * 64 + __builtin_ctzll(v));
+            return achado < fim ? achado : fim;
+        }
+        s = (uint32_t)((w + 1) * 64);
+    }
+    return fim;
+}
+
+// Conta os setores ocupados em [inicio, fim) usando popcount por palavra
+static uint32_t bitmap_contar_ocupados(const unsigned char *bitmap, uint32_t inicio, uint32_t fim) {
+    uint32_t total = 0;
+    uint64_t s = inicio;
+    while (s < fim) {
+        size_t w = s / 64;
+        unsigned b = s % 64;
+        unsigned len = (fim - s < 64 - b) ? (unsigned)(fim - s) : 64 - b;
+        total += __builtin_popcountll(bitmap_palavra(bitmap, w) & mascara_bits(b, len));
+        s += len;
+    }
+    return total;
+}
+
+static uint32_t indice_prioridade(FreeIndex *idx) {
+    // xorshift32: determinístico, suficiente para balancear o treap
+    uint32_t x = idx->seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    idx->seed = x;
+    return x;
+}
+
+static inline uint32_t max_count_de(const FreeExtent *t) {
+    return t ? t->max_count : 0;
+}
+
+static void atualizar_max(FreeExtent *t) {
+    uint32_t m = t->count;
+    if (max_count_de(t->left) > m) m = max_count_de(t->left);
+    if (max_count_de(t->right) > m) m = max_count_de(t->right);
+    t->max_count = m;
+}
+
+// Árvore por início: separa em (< key) e (>= key)
+static void dividir_inicio(FreeExtent *t, uint32_t key, FreeExtent **l, FreeExtent **r) {
+    if (!t) {
+        *l = *r = NULL;
+        return;
+    }
+    if (t->start < key) {
+        dividir_inicio(t->right, key, &t->right, r);
+        *l = t;
+    } else {
+        dividir_inicio(t->left, key, l, &t->left);
+        *r = t;
+    }
+    atualizar_max(t);
+}
+
+static FreeExtent *juntar_inicio(FreeExtent *l, FreeExtent *r) {
+    if (!l) return r;
+    if (!r) return l;
+    if (l->prio > r->prio) {
+        l->right = juntar_inicio(l->right, r);
+        atualizar_max(l);
+        return l;
+    }
+    r->left = juntar_inicio(l, r->left);
+    atualizar_max(r);
+    return r;
+}
+
+// Árvore por tamanho: chave (count, start)
+static inline int menor_tamanho(const FreeExtent *a, uint32_t count, uint32_t start) {
+    return a->count < count || (a->count == count && a->start < start);
+}
+
+static void dividir_tamanho(FreeExtent *t, uint32_t count, uint32_t start, FreeExtent **l, FreeExtent **r) {
+    if (!t) {
+        *l = *r = NULL;
+        return;
+    }
+    if (menor_tamanho(t, count, start)) {
+        dividir_tamanho(t->sright, count, start, &t->sright, r);
+        *l = t;
+    } else {
+        dividir_tamanho(t->sleft, count, start, l, &t->sleft);
+        *r = t;
+    }
+}
+
+static FreeExtent *juntar_tamanho(FreeExtent *l, FreeExtent *r) {
+    if (!l) return r;
+    if (!r) return l;
+    if (l->prio > r->prio) {
+        l->sright = juntar_tamanho(l->sright, r);
+        return l;
+    }
+    r->sleft = juntar_tamanho(l, r->sleft);
+    return r;
+}
+
+// Liga o nó e, como a faixa [start, start + count), às duas árvores
+static void indice_ligar(FreeIndex *idx, FreeExtent *e, uint32_t start, uint32_t count) {
+    memset(e, 0, sizeof(FreeExtent));
+    e->start = start;
+    e->count = count;
+    e->max_count = count;
+    e->prio = indice_prioridade(idx);
+
+    FreeExtent *l, *r;
+    dividir_inicio(idx->by_start, start, &l, &r);
+    idx->by_start = juntar_inicio(juntar_inicio(l, e), r);
+    dividir_tamanho(idx->by_size, count, start, &l, &r);
+    idx->by_size = juntar_tamanho(juntar_tamanho(l, e), r);
+
+    idx->free_sectors += count;
+    idx->extents++;
+}
+
+static int indice_inserir(FreeIndex *idx, uint32_t start, uint32_t count) {
+    FreeExtent *e = (FreeExtent *)calloc(1, sizeof(FreeExtent));
+    if (!e) {
+        perror("Erro ao alocar memória para índice de espaço livre");
+        return -1;
+    }
+    indice_ligar(idx, e, start, count);
+    return 0;
+}
+
+// Desliga do índice o nó da faixa e, sem liberá-lo
+static void indice_desligar(FreeIndex *idx, FreeExtent *e) {
+    FreeExtent *l, *m, *r;
+    dividir_inicio(idx->by_start, e->start, &l, &r);
+    dividir_inicio(r, e->start + 1, &m, &r);
+    idx->by_start = juntar_inicio(l, r);
+    dividir_tamanho(idx->by_size, e->count, e->start, &l, &r);
+    dividir_tamanho(r, e->count, e->start + 1, &m, &r);
+    idx->by_size = juntar_tamanho(l, r);
+
+    idx->free_sectors -= e->count;
+    idx->extents--;
+}
+
+static void indice_remover(FreeIndex *idx, FreeExtent *e) {
+    indice_desligar(idx, e);
+    free(e);
+}
+
+// Faixa livre com o maior início <= s (ou NULL)
+static FreeExtent *indice_anterior(const FreeIndex *idx, uint32_t s) {
+    FreeExtent *t = idx->by_start, *melhor = NULL;
+    while (t) {
+        if (t->start <= s) {
+            melhor = t;
+            t = t->right;
+        } else {
+            t = t->left;
+        }
+    }
+    return melhor;
+}
+
+// Primeira faixa (menor início) com pelo menos n setores
+static FreeExtent *buscar_first_fit(FreeExtent *t, uint32_t n) {
+    uint64_t passos = 0;
+    while (t && t->max_count >= n) {
+        passos++;
+        if (max_count_de(t->left) >= n) {
+            t = t->left;
+        } else if (t->count >= n) {
+            break;
+        } else {
+            t = t->right;
+        }
+    }
+    ESTAT(passos_alocador, passos);
+    return t && t->max_count >= n ? t : NULL;
+}
+
+// Primeira faixa com início >= hint e pelo menos n setores
+static FreeExtent *buscar_a_partir(FreeExtent *t, uint32_t n, uint32_t hint) {
+    if (!t || t->max_count < n) {
+        return NULL;
+    }
+    ESTAT(passos_alocador, 1);
+    if (t->start < hint) {
+        return buscar_a_partir(t->right, n, hint);
+    }
+    FreeExtent *achado = buscar_a_partir(t->left, n, hint);
+    if (achado) return achado;
+    if (t->count >= n) return t;
+    return buscar_first_fit(t->right, n);
+}
+
+// Menor faixa com pelo menos n setores (empate: menor início)
+static FreeExtent *buscar_best_fit(FreeExtent *t, uint32_t n) {
+    FreeExtent *melhor = NULL;
+    uint64_t passos = 0;
+    while (t) {
+        passos++;
+        if (t->count >= n) {
+            melhor = t;
+            t = t->sleft;
+        } else {
+            t = t->sright;
+        }
+    }
+    ESTAT(passos_alocador, passos);
+    return melhor;
+}
+
+static void indice_liberar_nos(FreeExtent *t) {
+    if (!t) return;
+    indice_liberar_nos(t->left);
+    indice_liberar_nos(t->right);
+    free(t);
+}
+
+static void indice_destruir(FreeIndex *idx) {
+    indice_liberar_nos(idx->by_start);
+    memset(idx, 0, sizeof(FreeIndex));
+}
+
+// Constrói o índice a partir dos 'nbits' primeiros bits do bitmap; o bit i
+// corresponde ao setor base + i. Sem memória o índice fica vazio e retorna -1.
+static int indice_construir(FreeIndex *idx, const unsigned char *bitmap, uint32_t nbits, uint32_t base) {
+    indice_destruir(idx);
+    idx->seed = 0x9E3779B9u;
+    idx->next_hint = base;
+
+    uint32_t s = bitmap_proximo(bitmap, 0, nbits, 0);
+    while (s < nbits) {
+        uint32_t e = bitmap_proximo(bitmap, s, nbits, 1);
+        if (indice_inserir(idx, base + s, e - s) != 0) {
+            indice_destruir(idx);
+            return -1;
+        }
+        s = bitmap_proximo(bitmap, e, nbits, 0);
+    }
+    return 0;
+}
+
+// Retira [s, s + n) da faixa livre 'e', devolvendo as sobras ao índice. O
+// nó de 'e' é reaproveitado; só o corte no meio aloca, antes de mexer no
+// índice, de modo que uma falha (-1) o deixa intacto.
+static int indice_ocupar(FreeIndex *idx, FreeExtent *e, uint32_t s, uint32_t n) {
+    uint32_t e_start = e->start;
+    uint32_t e_end = e->start + e->count;
+    FreeExtent *extra = NULL;
+    if (s > e_start && s + n < e_end) {
+        extra = (FreeExtent *)calloc(1, sizeof(FreeExtent));
+        if (!extra) {
+            perror("Erro ao alocar memória para índice de espaço livre");
+            return -1;
+        }
+    }
+    indice_desligar(idx, e);
+    if (s > e_start) {
+        indice_ligar(idx, e, e_start, s - e_start);
+        e = extra;
+    }
+    if (s + n < e_end) {
+        indice_ligar(idx, e, s + n, e_end - (s + n));
+    } else {
+        free(e);
+    }
+    return 0;
+}
+
+// Devolve [s, s + n) ao índice, unindo com as faixas vizinhas (cujo nó é
+// reaproveitado); sem vizinha e sem memória retorna -1 e o índice não muda
+static int indice_devolver(FreeIndex *idx, uint32_t s, uint32_t n) {
+    FreeExtent *no = NULL;
+    FreeExtent *ant = indice_anterior(idx, s);
+    if (ant && ant->start + ant->count == s) {
+        s = ant->start;
+        n += ant->count;
+        indice_desligar(idx, ant);
+        no = ant;
+    }
+    FreeExtent *prox = indice_anterior(idx, s + n);
+    if (prox && prox->start == s + n) {
+        n += prox->count;
+        if (no) {
+            indice_remover(idx, prox);
+        } else {
+            indice_desligar(idx, prox);
+            no = prox;
+        }
+    }
+    if (!no) {
+        return indice_inserir(idx, s, n);
+    }
+    indice_ligar(idx, no, s, n);
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Índice do diretório
+//
+// Tabela hash (endereçamento aberto, sondagem linear) da chave de 16 bytes
+// nome (12) + extensão (4) para a posição da entrada no diretório, e pilha de
+// entradas livres. Construídos na montagem e mantidos a cada criação/remoção,
+// tornam busca, verificação de duplicatas e reserva de entrada O(1).
+// ---------------------------------------------------------------------------
+
+#define NOME_CHAVE 16              // 12 (nome) + 4 (extensão), contíguos na DirEntry
+
+typedef struct {
+    int32_t *slots;                // posição da entrada no diretório, -1 = vazio
+    uint32_t mask;                 // tamanho da tabela - 1 (potência de 2)
+    int32_t *free_slots;           // pilha de entradas livres do diretório
+    uint32_t free_count;           // quantidade de entradas livres
+} DirIndex;
+
+// Chave de busca de uma entrada: filename seguido de extension
+static inline const char *chave_entrada(const DirEntry *entry) {
+    return entry->filename;
+}
+
+static inline uint64_t hash_chave(const char *chave) {
+    uint64_t a, b;
+    memcpy(&a, chave, 8);
+    memcpy(&b, chave + 8, 8);
+    uint64_t h = (a * 0x9E3779B97F4A7C15ULL) ^ (b + 0x632BE59BD9B4E019ULL);
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    return h;
+}
+
+// Converte "nome.extensão" na chave gravada no diretório (nome até o primeiro
+// ponto, truncado em 12 bytes; extensão truncada em 4; preenchidos com zeros)
+static void montar_chave(const char *nome, char chave[NOME_CHAVE]) {
+    memset(chave, 0, NOME_CHAVE);
+    const char *dot = strchr(nome, '.');
+    size_t name_len = dot ? (size_t)(dot - nome) : strlen(nome);
+    if (name_len > 12) {name_len = 12;}
+    memcpy(chave, nome, name_len);
+
+    if (dot) {
+        size_t ext_len = strlen(dot + 1);
+        if (ext_len > 4) {ext_len = 4;}
+        memcpy(chave + 12, dot + 1, ext_len);
+    }
+}
+
+static int dirindex_buscar(const DirIndex *idx, const DirEntry *dir, const char *chave) {
+    uint32_t p = (uint32_t)hash_chave(chave) & idx->mask;
+    uint64_t sondagens = 1;
+    while (idx->slots[p] != -1) {
+        if (memcmp(chave_entrada(&dir[idx->slots[p]]), chave, NOME_CHAVE) == 0) {
+            ESTAT(sondagens_dir, sondagens);
+            return idx->slots[p];
+        }
+        p = (p + 1) & idx->mask;
+        sondagens++;
+    }
+    ESTAT(sondagens_dir, sondagens);
+    return -1;
+}
+
+static void dirindex_inserir(DirIndex *idx, const DirEntry *dir, int i) {
+    uint32_t p = (uint32_t)hash_chave(chave_entrada(&dir[i])) & idx->mask;
+    uint64_t sondagens = 1;
+    while (idx->slots[p] != -1) {
+        p = (p + 1) & idx->mask;
+        sondagens++;
+    }
+    idx->slots[p] = i;
+    ESTAT(sondagens_dir, sondagens);
+}
+
+// Remove a entrada i da tabela, recuando os elementos seguintes do mesmo
+// agrupamento para não deixar marcas de remoção
+static void dirindex_remover(DirIndex *idx, const DirEntry *dir, int i) {
+    uint32_t p = (uint32_t)hash_chave(chave_entrada(&dir[i])) & idx->mask;
+    while (idx->slots[p] != i) {
+        if (idx->slots[p] == -1) return;
+        p = (p + 1) & idx->mask;
+    }
+
+    uint32_t j = p;
+    uint32_t k = p;
+    idx->slots[j] = -1;
+    for (;;) {
+        k = (k + 1) & idx->mask;
+        if (idx->slots[k] == -1) return;
+        uint32_t home = (uint32_t)hash_chave(chave_entrada(&dir[idx->slots[k]])) & idx->mask;
+        // slots[k] fica onde está se sua posição ideal está ciclicamente em (j, k]
+        int fica = (j <= k) ? (j < home && home <= k) : (j < home || home <= k);
+        if (!fica) {
+            idx->slots[j] = idx->slots[k];
+            idx->slots[k] = -1;
+            j = k;
+        }
+    }
+}
+
+static void dirindex_destruir(DirIndex *idx) {
+    free(idx->slots);
+    free(idx->free_slots);
+    memset(idx, 0, sizeof(DirIndex));
+}
+
+// Constrói a tabela e a pilha de entradas livres a partir do diretório
+static int dirindex_construir(DirIndex *idx, const DirEntry *dir, int dir_entries) {
+    uint32_t size = 16;
+    while (size < (uint32_t)dir_entries * 2) {
+        size <<= 1;
+    }
+    idx->mask = size - 1;
+    idx->slots = (int32_t *)malloc(size * sizeof(int32_t));
+    idx->free_slots = (int32_t *)malloc((dir_entries ? dir_entries : 1) * sizeof(int32_t));
+    idx->free_count = 0;
+    if (!idx->slots || !idx->free_slots) {
+        perror("Erro ao alocar memória para índice do diretório");
+        dirindex_destruir(idx);
+        return -1;
+    }
+    memset(idx->slots, 0xFF, size * sizeof(int32_t));
+
+    // Pilha em ordem decrescente: a menor entrada livre sai primeiro
+    for (int i = dir_entries - 1; i >= 0; i--) {
+        if (dir[i].status == 0x00) {
+            dirindex_inserir(idx, dir, i);
+        } else {
+            idx->free_slots[idx->free_count++] = i;
+        }
+    }
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Setores de fragmentos
+//
+// Arquivos pequenos e caudas curtas de arquivos maiores são empacotados em
+// setores compartilhados, divididos em FRAG_UNIDADES unidades. A ocupação
+// dos setores de fragmentos não é gravada no disco: é refeita na montagem a
+// partir das entradas do diretório com ATRIB_CAUDA e mantida em uma tabela
+// hash (endereçamento aberto, sondagem linear) indexada pelo setor.
+// ---------------------------------------------------------------------------
+
+#define FRAG_UNIDADES 64           // unidades por setor de fragmentos (um bit cada em mapa)
+#define FRAG_SONDAGENS 64          // setores examinados antes de alocar um setor novo
+
+typedef struct {
+    uint32_t setor;                // 0 = posição vazia
+    uint64_t mapa;                 // bit i = unidade i ocupada
+} SetorFragmentos;
+
+typedef struct {
+    SetorFragmentos *tabela;
+    uint32_t mask;                 // tamanho da tabela - 1 (potência de 2)
+    uint32_t quantidade;           // setores de fragmentos em uso
+    uint32_t corrente;             // setor da última cauda gravada (0 = nenhum)
+    uint32_t cursor;               // próxima posição da tabela a examinar
+} FragIndex;
+
+static inline uint32_t frag_hash(uint32_t setor) {
+    return setor * 0x9E3779B1u;
+}
+
+// Unidades ocupadas por 'bytes' bytes de um setor de 'bps' bytes
+static inline uint64_t frag_mascara(uint32_t bps, uint32_t offset, uint32_t bytes) {
+    uint32_t unidade = bps / FRAG_UNIDADES;
+    uint32_t primeira = offset / unidade;
+    uint32_t n = (bytes + unidade - 1) / unidade;
+    return (n >= 64 ? ~0ULL : ((1ULL << n) - 1)) << primeira;
+}
+
+static SetorFragmentos *frag_buscar(const FragIndex *idx, uint32_t setor) {
+    if (!idx->tabela) {
+        return NULL;
+    }
+    uint32_t p = frag_hash(setor) & idx->mask;
+    while (idx->tabela[p].setor != 0) {
+        if (idx->tabela[p].setor == setor) {
+            return &idx->tabela[p];
+        }
+        p = (p + 1) & idx->mask;
+    }
+    return NULL;
+}
+
+static void frag_colocar(FragIndex *idx, uint32_t setor, uint64_t mapa) {
+    uint32_t p = frag_hash(setor) & idx->mask;
+    while (idx->tabela[p].setor != 0) {
+        p = (p + 1) & idx->mask;
+    }
+    idx->tabela[p].setor = setor;
+    idx->tabela[p].mapa = mapa;
+}
+
+// Acrescenta um setor vazio, dobrando a tabela quando passa da metade
+static SetorFragmentos *frag_inserir(FragIndex *idx, uint32_t setor) {
+    if (!idx->tabela || (idx->quantidade + 1) * 2 > idx->mask + 1) {
+        uint32_t tamanho = idx->tabela ? (idx->mask + 1) * 2 : 64;
+        SetorFragmentos *antiga = idx->tabela;
+        uint32_t antiga_mask = idx->mask;
+        idx->tabela = (SetorFragmentos *)calloc(tamanho, sizeof(SetorFragmentos));
+        if (!idx->tabela) {
+            idx->tabela = antiga;
+            return NULL;
+        }
+        idx->mask = tamanho - 1;
+        for (uint32_t i = 0; antiga && i <= antiga_mask; i++) {
+            if (antiga[i].setor != 0) frag_colocar(idx, antiga[i].setor, antiga[i].mapa);
+        }
+        free(antiga);
+    }
+    frag_colocar(idx, setor, 0);
+    idx->quantidade++;
+    return frag_buscar(idx, setor);
+}
+
+// Remove o setor da tabela, recuando os elementos seguintes do mesmo
+// agrupamento (como em dirindex_remover)
+static void frag_remover(FragIndex *idx, uint32_t setor) {
+    SetorFragmentos *f = frag_buscar(idx, setor);
+    if (!f) {
+        return;
+    }
+    uint32_t j = (uint32_t)(f - idx->tabela);
+    uint32_t k = j;
+    idx->tabela[j].setor = 0;
+    idx->quantidade--;
+    if (idx->corrente == setor) {
+        idx->corrente = 0;
+    }
+    for (;;) {
+        k = (k + 1) & idx->mask;
+        if (idx->tabela[k].setor == 0) return;
+        uint32_t home = frag_hash(idx->tabela[k].setor) & idx->mask;
+        int fica = (j <= k) ? (j < home && home <= k) : (j < home || home <= k);
+        if (!fica) {
+            idx->tabela[j] = idx->tabela[k];
+            idx->tabela[k].setor = 0;
+            j = k;
+        }
+    }
+}
+
+// Primeira sequência de n unidades livres no mapa, ou -1
+static int frag_procurar(uint64_t mapa, uint32_t n) {
+    if (n > FRAG_UNIDADES) {
+        return -1;
+    }
+    uint64_t bloco = n >= 64 ? ~0ULL : ((1ULL << n) - 1);
+    for (uint32_t i = 0; i + n <= FRAG_UNIDADES; i++) {
+        if ((mapa & (bloco << i)) == 0) return (int)i;
+    }
+    return -1;
+}
+
+static void frag_destruir(FragIndex *idx) {
+    free(idx->tabela);
+    memset(idx, 0, sizeof(FragIndex));
+}
+
+// Refaz a ocupação dos setores de fragmentos a partir das caudas do
+// diretório; caudas fora da área de dados ou sobrepostas são descartadas
+static int frag_construir(FragIndex *idx, DirEntry *dir, int dir_entries, uint32_t bps,
+                   uint32_t data_start, uint32_t data_end) {
+    memset(idx, 0, sizeof(FragIndex));
+    for (int i = 0; i < dir_entries; i++) {
+        DirEntry *entry = &dir[i];
+        if (entry->status != 0x00 || !(entry->attributes & ATRIB_CAUDA)) {
+            continue;
+        }
+        uint32_t setor = entry->tail_sector;
+        uint64_t mascara = frag_mascara(bps, entry->tail_offset, entry->tail_length);
+        SetorFragmentos *f = frag_buscar(idx, setor);
+        if (setor < data_start || setor >= data_end || entry->tail_length == 0 ||
+            (uint32_t)entry->tail_offset + entry->tail_length > bps || (f && (f->mapa & mascara))) {
+            printf("Aviso: Cauda inválida em %s.%s ignorada\n", entry->filename, entry->extension);
+            continue;
+        }
+        if (!f && !(f = frag_inserir(idx, setor))) {
+            perror("Erro ao alocar memória para setores de fragmentos");
+            frag_destruir(idx);
+            return -1;
+        }
+        f->mapa |= mascara;
+    }
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Cache de blocos
+//
+// Leituras e escritas da área de dados pelo caminho com buffer passam por um
+// cache de tamanho fixo, em blocos do volume (bytes por setor × setores por
+// bloco, até 64 setores). A substituição segue o algoritmo CLOCK; blocos
+// fixados (pinos > 0) nunca são escolhidos. Escritas ficam no cache
+// (write-back) e cada bloco guarda quais setores foram alterados, os únicos
+// gravados de volta: setores vizinhos escritos fora do cache, ou do journal,
+// nunca são sobrescritos com uma cópia antiga. Faltas em blocos consecutivos
+// de leitura disparam leitura antecipada. Uma escrita não lê o bloco: só os
+// setores que ela cobre em parte são completados do disco, e nem esses
+// quando o restante do setor não guarda dados (área recém-alocada ou além do
+// fim do arquivo). Cada bloco registra quais setores já são válidos.
+// ---------------------------------------------------------------------------
+
+// Tamanho padrão do cache de blocos (0 = desativado)
+#define CACHE_SIZE_PADRAO (8 << 20)
+// Blocos lidos antecipadamente em uma falta sequencial
+#define CACHE_READAHEAD 16
+// Blocos por escrita vetorial ao descarregar o cache
+#define CACHE_IOV 64
+
+#define BLOCO_LIVRE UINT64_MAX
+
+typedef struct {
+    uint64_t bloco;            // número do bloco na imagem (BLOCO_LIVRE = vazio)
+    unsigned char *dados;
+    uint64_t sujos;            // bit i = setor i do bloco alterado
+    uint64_t validos;          // bit i = setor i lido do disco ou escrito
+    int pinos;                 // referências que impedem a substituição
+    int referenciado;          // bit de uso do CLOCK
+    int32_t proximo;           // próximo bloco na mesma lista do hash (-1 = fim)
+} BlocoCache;
+
+typedef struct {
+    BlocoCache *blocos;
+    unsigned char *memoria;
+    uint32_t quantidade;       // blocos no cache (0 = desativado)
+    size_t tam_bloco;
+    size_t tam_setor;
+    int32_t *hash;             // primeiro bloco de cada lista
+    uint32_t hash_mask;
+    uint32_t ponteiro;         // posição do CLOCK
+    uint64_t ultima_falta;     // bloco da última falta (detecção de acesso sequencial)
+    uint64_t limite;           // fim da imagem em bytes
+    uint64_t acertos, faltas, antecipados, gravados;
+    pthread_mutex_t trava;
+} CacheBlocos;
+
+static int cache_criar(CacheBlocos *c, size_t tamanho, size_t tam_setor, uint32_t setores_por_bloco, uint64_t limite) {
+    memset(c, 0, sizeof(CacheBlocos));
+    size_t tam_bloco = tam_setor * (setores_por_bloco == 0 ? 1 : setores_por_bloco > 64 ? 64 : setores_por_bloco);
+    c->tam_setor = tam_setor;
+    c->tam_bloco = tam_bloco;
+    c->limite = limite;
+    c->ultima_falta = BLOCO_LIVRE;
+    pthread_mutex_init(&c->trava, NULL);
+    uint32_t n = (uint32_t)(tamanho / tam_bloco);
+    if (n < 2 * CACHE_READAHEAD) {
+        return 0;
+    }
+
+    uint32_t buckets = 1;
+    while (buckets < n * 2) buckets <<= 1;
+    c->blocos = (BlocoCache *)calloc(n, sizeof(BlocoCache));
+    c->hash = (int32_t *)malloc(buckets * sizeof(int32_t));
+    if (!c->blocos || !c->hash || posix_memalign((void **)&c->memoria, 4096, (size_t)n * tam_bloco) != 0) {
+        perror("Erro ao alocar memória para o cache de blocos");
+        free(c->blocos);
+        free(c->hash);
+        c->blocos = NULL;
+        c->hash = NULL;
+        return -1;
+    }
+    memset(c->hash, 0xFF, buckets * sizeof(int32_t));
+    for (uint32_t i = 0; i < n; i++) {
+        c->blocos[i].bloco = BLOCO_LIVRE;
+        c->blocos[i].dados = c->memoria + (size_t)i * tam_bloco;
+        c->blocos[i].proximo = -1;
+    }
+    c->quantidade = n;
+    c->hash_mask = buckets - 1;
+    return 0;
+}
+
+static void cache_destruir(CacheBlocos *c) {
+    free(c->blocos);
+    free(c->hash);
+    free(c->memoria);
+    pthread_mutex_destroy(&c->trava);
+    memset(c, 0, sizeof(CacheBlocos));
+}
+
+static inline uint32_t cache_bucket(const CacheBlocos *c, uint64_t bloco) {
+    return (uint32_t)((bloco * 0x9E3779B97F4A7C15ULL) >> 32) & c->hash_mask;
+}
+
+static int32_t cache_procurar(const CacheBlocos *c, uint64_t bloco) {
+    int32_t i = c->hash[cache_bucket(c, bloco)];
+    while (i >= 0 && c->blocos[i].bloco != bloco) {
+        i = c->blocos[i].proximo;
+    }
+    return i;
+}
+
+static void cache_desligar(CacheBlocos *c, int32_t i) {
+    int32_t *p = &c->hash[cache_bucket(c, c->blocos[i].bloco)];
+    while (*p != i) {
+        p = &c->blocos[*p].proximo;
+    }
+    *p = c->blocos[i].proximo;
+    c->blocos[i].bloco = BLOCO_LIVRE;
+    c->blocos[i].proximo = -1;
+}
+
+static void cache_ligar(CacheBlocos *c, int32_t i, uint64_t bloco) {
+    uint32_t h = cache_bucket(c, bloco);
+    c->blocos[i].bloco = bloco;
+    c->blocos[i].proximo = c->hash[h];
+    c->hash[h] = i;
+}
+
+// Próxima sequência de setores alterados do bloco a partir do setor *i
+static int proxima_sequencia_suja(uint64_t sujos, unsigned *i, unsigned *n) {
+    uint64_t resto = *i < 64 ? sujos >> *i : 0;
+    if (resto == 0) {
+        return 0;
+    }
+    *i += (unsigned)__builtin_ctzll(resto);
+    resto = sujos >> *i;
+    *n = ~resto == 0 ? 64 - *i : (unsigned)__builtin_ctzll(~resto);
+    return 1;
+}
+
+// Grava no disco os setores alterados do bloco
+static int cache_gravar_bloco(CacheBlocos *c, int fd, BlocoCache *b) {
+    unsigned i = 0, n;
+    while (proxima_sequencia_suja(b->sujos, &i, &n)) {
+        off_t off = (off_t)(b->bloco * c->tam_bloco + (uint64_t)i * c->tam_setor);
+        if (escrever_em(fd, b->dados + (size_t)i * c->tam_setor, (size_t)n * c->tam_setor, off) != 0) {
+            return -1;
+        }
+        i += n;
+    }
+    if (b->sujos) {
+        b->sujos = 0;
+        c->gravados++;
+    }
+    return 0;
+}
+
+// Escolhe um bloco para substituir (CLOCK), gravando-o se estiver sujo
+static int32_t cache_vitima(CacheBlocos *c, int fd) {
+    for (uint32_t voltas = 0; voltas < 2 * c->quantidade + 1; voltas++) {
+        int32_t i = (int32_t)c->ponteiro;
+        c->ponteiro = (c->ponteiro + 1) % c->quantidade;
+        BlocoCache *b = &c->blocos[i];
+        if (b->pinos > 0) continue;
+        if (b->referenciado) {
+            b->referenciado = 0;
+            continue;
+        }
+        if (cache_gravar_bloco(c, fd, b) != 0) {
+            return -1;
+        }
+        if (b->bloco != BLOCO_LIVRE) {
+            cache_desligar(c, i);
+        }
+        return i;
+    }
+    errno = ENOBUFS;
+    return -1;
+}
+
+// Carrega o bloco no cache; em falta sequencial lê também os blocos
+// seguintes com uma única leitura vetorial. Sem 'ler' o bloco entra sem
+// nenhum setor válido. O bloco retornado fica fixado.
+static int32_t cache_carregar(CacheBlocos *c, int fd, uint64_t bloco, int ler) {
+    int32_t i = cache_procurar(c, bloco);
+    if (i >= 0) {
+        c->acertos++;
+        c->blocos[i].pinos++;
+        c->blocos[i].referenciado = 1;
+        return i;
+    }
+    c->faltas++;
+
+    uint64_t blocos_imagem = (c->limite + c->tam_bloco - 1) / c->tam_bloco;
+    uint32_t n = 1;
+    if (ler && c->ultima_falta != BLOCO_LIVRE && bloco == c->ultima_falta + 1) {
+        // Antecipa apenas blocos que ainda não estão no cache
+        while (n < CACHE_READAHEAD && bloco + n < blocos_imagem && cache_procurar(c, bloco + n) < 0) n++;
+    }
+    if (ler) {
+        c->ultima_falta = bloco + n - 1;
+    }
+
+    int32_t escolhidos[CACHE_READAHEAD];
+    struct iovec iov[CACHE_READAHEAD];
+    for (uint32_t k = 0; k < n; k++) {
+        escolhidos[k] = cache_vitima(c, fd);
+        if (escolhidos[k] < 0) {
+            for (uint32_t j = 0; j < k; j++) c->blocos[escolhidos[j]].pinos--;
+            return -1;
+        }
+        c->blocos[escolhidos[k]].pinos++;
+        iov[k].iov_base = c->blocos[escolhidos[k]].dados;
+        iov[k].iov_len = c->tam_bloco;
+    }
+
+    if (ler) {
+        // O último bloco da imagem pode ser parcial
+        off_t off = (off_t)(bloco * c->tam_bloco);
+        uint64_t total = (uint64_t)n * c->tam_bloco;
+        if (off + total > c->limite) {
+            iov[n - 1].iov_len -= (size_t)(off + total - c->limite);
+            total = c->limite - off;
+        }
+        ssize_t lidos;
+        do {
+            lidos = preadv(fd, iov, (int)n, off);
+            estat_acesso(off, lidos > 0 ? (size_t)lidos : 0, 0);
+        } while (lidos < 0 && errno == EINTR);
+        if (lidos < (ssize_t)total) {
+            if (lidos >= 0) errno = EIO;
+            for (uint32_t k = 0; k < n; k++) c->blocos[escolhidos[k]].pinos--;
+            return -1;
+        }
+    }
+
+    for (uint32_t k = 0; k < n; k++) {
+        cache_ligar(c, escolhidos[k], bloco + k);
+        c->blocos[escolhidos[k]].validos = ler ? ~0ULL : 0;
+        c->blocos[escolhidos[k]].referenciado = k == 0;
+        if (k > 0) c->blocos[escolhidos[k]].pinos--;
+    }
+    c->antecipados += n - 1;
+    return escolhidos[0];
+}
+
+// Lê do disco os setores de 'mascara' que ainda não são válidos no bloco
+static int cache_completar(CacheBlocos *c, int fd, BlocoCache *b, uint64_t mascara) {
+    unsigned i = 0, n;
+    while (proxima_sequencia_suja(mascara & ~b->validos, &i, &n)) {
+        uint64_t off = b->bloco * c->tam_bloco + (uint64_t)i * c->tam_setor;
+        uint64_t len = (uint64_t)n * c->tam_setor;
+        if (off >= c->limite) {
+            memset(b->dados + (size_t)i * c->tam_setor, 0, (size_t)len);
+        } else {
+            // O último bloco da imagem pode ser parcial
+            uint64_t lidos = off + len > c->limite ? c->limite - off : len;
+            if (ler_em(fd, b->dados + (size_t)i * c->tam_setor, (size_t)lidos, (off_t)off) != 0) {
+                return -1;
+            }
+        }
+        b->validos |= mascara_bits(i, n);
+        i += n;
+    }
+    return 0;
+}
+
+// Lê len bytes da imagem a partir de off pelo cache
+static int cache_ler(CacheBlocos *c, int fd, void *buf, size_t len, off_t off) {
+    unsigned char *p = (unsigned char *)buf;
+    pthread_mutex_lock(&c->trava);
+    while (len > 0) {
+        uint64_t bloco = (uint64_t)off / c->tam_bloco;
+        size_t dentro = (size_t)((uint64_t)off % c->tam_bloco);
+        size_t n = c->tam_bloco - dentro < len ? c->tam_bloco - dentro : len;
+        int32_t i = cache_carregar(c, fd, bloco, 1);
+        unsigned primeiro = (unsigned)(dentro / c->tam_setor);
+        unsigned ultimo = (unsigned)((dentro + n - 1) / c->tam_setor);
+        if (i >= 0 && cache_completar(c, fd, &c->blocos[i], mascara_bits(primeiro, ultimo - primeiro + 1)) != 0) {
+            c->blocos[i].pinos--;
+            i = -1;
+        }
+        if (i < 0) {
+            pthread_mutex_unlock(&c->trava);
+            return -1;
+        }
+        memcpy(p, c->blocos[i].dados + dentro, n);
+        c->blocos[i].pinos--;
+        p += n;
+        off += (off_t)n;
+        len -= n;
+    }
+    pthread_mutex_unlock(&c->trava);
+    return 0;
+}
+
+// Escreve len bytes na imagem a partir de off pelo cache (write-back). Com
+// 'novo' o restante do último setor não guarda dados e é zerado.
+static int cache_escrever(CacheBlocos *c, int fd, const void *buf, size_t len, off_t off, int novo) {
+    const unsigned char *p = (const unsigned char *)buf;
+    pthread_mutex_lock(&c->trava);
+    while (len > 0) {
+        uint64_t bloco = (uint64_t)off / c->tam_bloco;
+        size_t dentro = (size_t)((uint64_t)off % c->tam_bloco);
+        size_t n = c->tam_bloco - dentro < len ? c->tam_bloco - dentro : len;
+        unsigned primeiro = (unsigned)(dentro / c->tam_setor);
+        unsigned ultimo = (unsigned)((dentro + n - 1) / c->tam_setor);
+        size_t resto = (dentro + n) % c->tam_setor;
+
+        // Só os setores cobertos em parte precisam do conteúdo do disco
+        uint64_t parciais = 0;
+        if (dentro % c->tam_setor) parciais |= 1ULL << primeiro;
+        if (resto && !novo) parciais |= 1ULL << ultimo;
+        int32_t i = cache_carregar(c, fd, bloco, 0);
+        if (i >= 0 && cache_completar(c, fd, &c->blocos[i], parciais) != 0) {
+            c->blocos[i].pinos--;
+            i = -1;
+        }
+        if (i < 0) {
+            pthread_mutex_unlock(&c->trava);
+            return -1;
+        }
+        BlocoCache *b = &c->blocos[i];
+        if (resto && novo && !(b->validos & (1ULL << ultimo))) {
+            memset(b->dados + dentro + n, 0, c->tam_setor - resto);
+        }
+        memcpy(b->dados + dentro, p, n);
+        b->sujos |= mascara_bits(primeiro, ultimo - primeiro + 1);
+        b->validos |= mascara_bits(primeiro, ultimo - primeiro + 1);
+        b->pinos--;
+        p += n;
+        off += (off_t)n;
+        len -= n;
+    }
+    pthread_mutex_unlock(&c->trava);
+    return 0;
+}
+
+static int comparar_blocos(const void *a, const void *b) {
+    uint64_t x = (*(BlocoCache *const *)a)->bloco;
+    uint64_t y = (*(BlocoCache *const *)b)->bloco;
+    return x < y ? -1 : x > y;
+}
+
+// Grava todos os blocos sujos, em ordem de posição; sequências de setores
+// alterados que continuam no bloco seguinte vão juntas em um único pwritev.
+// Retorna a quantidade de blocos gravados ou -1.
+static int cache_descarregar(CacheBlocos *c, int fd) {
+    if (c->quantidade == 0) {
+        return 0;
+    }
+    pthread_mutex_lock(&c->trava);
+    BlocoCache **sujos = (BlocoCache **)malloc(c->quantidade * sizeof(BlocoCache *));
+    if (!sujos) {
+        pthread_mutex_unlock(&c->trava);
+        return -1;
+    }
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < c->quantidade; i++) {
+        if (c->blocos[i].sujos) sujos[n++] = &c->blocos[i];
+    }
+    qsort(sujos, n, sizeof(BlocoCache *), comparar_blocos);
+
+    struct iovec iov[CACHE_IOV];
+    int qtd_iov = 0;
+    off_t inicio = 0;
+    uint64_t fim = 0;
+    size_t total = 0;
+    int r = 0;
+    for (uint32_t k = 0; k <= n && r == 0; k++) {
+        unsigned i = 0, q = 0;
+        int tem = k < n && proxima_sequencia_suja(sujos[k]->sujos, &i, &q);
+        while (r == 0 && (tem || k == n)) {
+            uint64_t off = k < n ? sujos[k]->bloco * c->tam_bloco + (uint64_t)i * c->tam_setor : 0;
+            // Fecha a escrita em andamento se a próxima sequência não a continua
+            if (qtd_iov > 0 && (k == n || off != fim || qtd_iov == CACHE_IOV)) {
+                ssize_t gravados;
+                do {
+                    gravados = pwritev(fd, iov, qtd_iov, inicio);
+                    estat_acesso(inicio, gravados > 0 ? (size_t)gravados : 0, 1);
+                } while (gravados < 0 && errno == EINTR);
+                if (gravados != (ssize_t)total) {
+                    if (gravados >= 0) errno = EIO;
+                    r = -1;
+                }
+                qtd_iov = 0;
+                total = 0;
+            }
+            if (k == n) break;
+            if (qtd_iov == 0) inicio = (off_t)off;
+            iov[qtd_iov].iov_base = sujos[k]->dados + (size_t)i * c->tam_setor;
+            iov[qtd_iov].iov_len = (size_t)q * c->tam_setor;
+            qtd_iov++;
+            total += (size_t)q * c->tam_setor;
+            fim = off + (uint64_t)q * c->tam_setor;
+            i += q;
+            tem = proxima_sequencia_suja(sujos[k]->sujos, &i, &q);
+            if (!tem) break;
+        }
+        if (k < n && r == 0) c->gravados++;
+    }
+    if (r == 0) {
+        for (uint32_t k = 0; k < n; k++) sujos[k]->sujos = 0;
+    }
+    free(sujos);
+    pthread_mutex_unlock(&c->trava);
+    return r == 0 ? (int)n : -1;
+}
+
+// Prepara [off, off + len) para acesso direto ao arquivo, fora do cache:
+// blocos sujos são gravados e, se 'descartar', removidos do cache
+static int cache_contornar(CacheBlocos *c, int fd, off_t off, uint64_t len, int descartar) {
+    if (c->quantidade == 0 || len == 0) {
+        return 0;
+    }
+    pthread_mutex_lock(&c->trava);
+    uint64_t primeiro = (uint64_t)off / c->tam_bloco;
+    uint64_t ultimo = ((uint64_t)off + len - 1) / c->tam_bloco;
+    int r = 0;
+    if (ultimo - primeiro < c->quantidade) {
+        for (uint64_t b = primeiro; b <= ultimo && r == 0; b++) {
+            int32_t i = cache_procurar(c, b);
+            if (i < 0) continue;
+            r = cache_gravar_bloco(c, fd, &c->blocos[i]);
+            if (r == 0 && descartar) cache_desligar(c, i);
+        }
+    } else {
+        // Faixa maior que o cache: percorre os blocos presentes
+        for (uint32_t i = 0; i < c->quantidade && r == 0; i++) {
+            uint64_t b = c->blocos[i].bloco;
+            if (b == BLOCO_LIVRE || b < primeiro || b > ultimo) continue;
+            r = cache_gravar_bloco(c, fd, &c->blocos[i]);
+            if (r == 0 && descartar) cache_desligar(c, (int32_t)i);
+        }
+    }
+    pthread_mutex_unlock(&c->trava);
+    return r;
+}
+
+// Setores de metadados limpos entre duas faixas sujas que ainda compensa
+// regravar para unir as faixas em uma única escrita
+#define META_GAP_MAX 4
+
+// Volume montado: boot record, diretório e bitmap são lidos uma única vez
+// e servidos da memória até a próxima sincronização
+struct Volume {
+    int fd;                    // imagem do disco aberta em leitura/escrita
+    int backend;               // BACKEND_STDIO ou BACKEND_MMAP
+    unsigned char *map;        // imagem mapeada (apenas BACKEND_MMAP)
+    size_t map_size;           // tamanho do mapeamento
+    unsigned char *meta;       // cópia em memória dos setores de metadados
+    size_t meta_size;          // tamanho dos metadados em bytes
+    BootRecord *br;            // boot record dentro de meta
+    DirEntry *dir;             // entradas do diretório dentro de meta
+    unsigned char *bitmap;     // bitmap dentro de meta
+    int dir_entries;           // quantidade de entradas do diretório
+    size_t bitmap_size;        // tamanho do bitmap em bytes
+    unsigned char *meta_dirty; // um bit por setor de metadados alterado desde a última sincronização
+    uint32_t meta_sectors;     // quantidade de setores de metadados
+    uint32_t dirty_count;      // setores marcados em meta_dirty
+    uint32_t journal_start;    // primeiro setor do journal
+    uint32_t journal_half;     // setores de cada metade do journal
+    uint32_t journal_cap;      // setores de metadados por transação
+    uint64_t journal_seq;      // sequência da próxima transação
+    int journal_usado;         // há transações no journal desde a última limpeza
+    int barreira_dados;        // dados gravados desde a última transação que ela passa a referenciar
+    int sync_interval;         // cópia de MountOptions.sync_interval
+    int pending_ops;           // operações desde a última sincronização
+    int alloc_policy;          // cópia de MountOptions.alloc_policy
+    uint32_t bytes_per_sector; // cópia de br->bytes_por_sector
+    size_t transfer_size;      // tamanho das transferências, múltiplo do bloco
+    int io_engine;             // cópia de MountOptions.io_engine
+    int zc_indisponivel;       // mecanismos zero-copy que falharam (ZC_*)
+    int queue_depth;           // cópia de MountOptions.queue_depth
+    int uring_indisponivel;    // io_uring recusado pelo kernel
+    int report;                // cópia de MountOptions.report
+    int threads;               // cópia de MountOptions.threads
+    pthread_mutex_t trava_posicao; // protege a posição corrente de fd (sendfile)
+    CacheBlocos cache;         // cache de blocos da área de dados (backend stdio)
+    int punch;                 // cópia de MountOptions.punch (0 se o host recusar)
+    uint32_t setores_host;     // setores por bloco do sistema de arquivos do host
+    uint32_t *liberados;       // pares (início, quantidade) liberados desde a última transação
+    uint32_t liberados_qtd;    // pares em liberados
+    uint32_t liberados_cap;    // capacidade de liberados, em pares
+    uint32_t *caudas_liberadas; // trios (setor, offset, bytes) liberados desde a última transação
+    uint32_t caudas_qtd;       // trios em caudas_liberadas
+    uint32_t caudas_cap;       // capacidade de caudas_liberadas, em trios
+    uint64_t bytes_devolvidos; // bytes desalocados no host desde a montagem
+    uint32_t data_start;       // primeiro setor da área de dados
+    uint32_t data_end;         // limite (não incluso) da área de dados
+    FreeIndex livres;          // índice de faixas livres da área de dados (ver indice_livre)
+    int indice_pronto;         // livres já construído
+    DirIndex nomes;            // índice de nomes e entradas livres do diretório
+    int empacotar;             // cópia de MountOptions.empacotar
+    int comprimir;             // cópia de MountOptions.comprimir
+    FragIndex fragmentos;      // ocupação dos setores de fragmentos
+    EstatOperacao estat[OP_TIPOS]; // contadores por tipo de operação desde a montagem
+};
+
+// Converte um tamanho com sufixo opcional K, M ou G (potências de 1024)
+uint64_t ler_tamanho(const char *texto) {
+    char *fim;
+    uint64_t valor = strtoull(texto, &fim, 10);
+    switch (*fim) {
+        case 'k': case 'K': valor <<= 10; break;
+        case 'm': case 'M': valor <<= 20; break;
+        case 'g': case 'G': valor <<= 30; break;
+    }
+    return valor;
+}
+
+void opcoes_padrao(MountOptions *opts) {
+    opts->sync_interval = SYNC_INTERVAL_PADRAO;
+    opts->alloc_policy = ALOC_FIRST_FIT;
+    opts->transfer_size = TRANSFER_SIZE_PADRAO;
+    opts->backend = BACKEND_STDIO;
+    opts->io_engine = MOTOR_BUFFER;
+    opts->queue_depth = QUEUE_DEPTH_PADRAO;
+    opts->cache_size = CACHE_SIZE_PADRAO;
+    opts->punch = 1;
+    opts->empacotar = 1;
+    opts->comprimir = 0;
+    opts->report = 0;
+
+    // Uma thread por CPU disponível, até THREADS_MAX
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    opts->threads = cpus < 1 ? 1 : cpus > THREADS_MAX ? THREADS_MAX : (int)cpus;
+}
+
+// Sobrescreve as opções com as variáveis de ambiente SA_*, quando definidas
+void opcoes_do_ambiente(MountOptions *opts) {
+    const char *valor = getenv("SA_SYNC_INTERVAL");
+    if (valor && *valor) {
+        opts->sync_interval = atoi(valor);
+        if (opts->sync_interval < 0) opts->sync_interval = 0;
+    }
+
+    valor = getenv("SA_ALLOC");
+    if (valor && *valor) {
+        if (strcmp(valor, "best") == 0) {
+            opts->alloc_policy = ALOC_BEST_FIT;
+        } else if (strcmp(valor, "next") == 0) {
+            opts->alloc_policy = ALOC_NEXT_FIT;
+        } else {
+            opts->alloc_policy = ALOC_FIRST_FIT;
+        }
+    }
+
+    valor = getenv("SA_TRANSFER_SIZE");
+    if (valor && *valor) {
+        opts->transfer_size = (size_t)ler_tamanho(valor);
+    }
+
+    valor = getenv("SA_BACKEND");
+    if (valor && *valor) {
+        opts->backend = strcmp(valor, "mmap") == 0 ? BACKEND_MMAP : BACKEND_STDIO;
+    }
+
+    valor = getenv("SA_IO_ENGINE");
+    if (valor && *valor) {
+        opts->io_engine = strcmp(valor, "zerocopy") == 0 ? MOTOR_ZERO_COPY
+                        : strcmp(valor, "uring") == 0 ? MOTOR_IO_URING : MOTOR_BUFFER;
+    }
+
+    valor = getenv("SA_CACHE_SIZE");
+    if (valor && *valor) {
+        opts->cache_size = (size_t)ler_tamanho(valor);
+    }
+
+    valor = getenv("SA_QUEUE_DEPTH");
+    if (valor && *valor) {
+        int n = atoi(valor);
+        opts->queue_depth = n < 1 ? 1 : n > QUEUE_DEPTH_MAX ? QUEUE_DEPTH_MAX : n;
+    }
+
+    valor = getenv("SA_PUNCH");
+    if (valor && *valor) {
+        opts->punch = atoi(valor) != 0;
+    }
+
+    valor = getenv("SA_PACK");
+    if (valor && *valor) {
+        opts->empacotar = atoi(valor) != 0;
+    }
+
+    valor = getenv("SA_COMPRESS");
+    if (valor && *valor) {
+        opts->comprimir = atoi(valor) != 0;
+    }
+
+    valor = getenv("SA_REPORT");
+    if (valor && *valor) {
+        opts->report = atoi(valor) != 0;
+    }
+
+    valor = getenv("SA_THREADS");
+    if (valor && *valor) {
+        int n = atoi(valor);
+        opts->threads = n < 1 ? 1 : n > THREADS_MAX ? THREADS_MAX : n;
+    }
+}
+
+// Libera a cópia dos metadados e desfaz o mapeamento da imagem
+static void liberar_metadados(Volume *vol) {
+    if (vol->map) {
+        munmap(vol->map, vol->map_size);
+    }
+    free(vol->meta);
+    vol->map = NULL;
+    vol->meta = NULL;
+}
+
+// ---------------------------------------------------------------------------
+// Journal de metadados
+//
+// Cada sincronização é uma transação: as imagens dos setores de metadados
+// sujos são gravadas juntas em uma metade do journal, com um único
+// fdatasync, e só então escritas no lugar definitivo (sem esperar o disco).
+// As metades se alternam, de modo que a transação anterior só é
+// sobrescrita depois que o fdatasync da seguinte tornou suas escritas
+// duráveis. Na montagem as transações válidas são reaplicadas em ordem de
+// sequência; na desmontagem limpa o journal é esvaziado. Cada metade
+// comporta a maior transação possível (todos os setores de metadados que
+// mudam), de modo que os metadados nunca são gravados fora do journal.
+// ---------------------------------------------------------------------------
+
+// FNV-1a de 32 bits, continuando a partir de h
+static uint32_t journal_checksum(const unsigned char *p, size_t len, uint32_t h) {
+    for (size_t i = 0; i < len; i++) {
+        h ^= p[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static inline uint32_t journal_inicio(const BootRecord *br) {
+    return br->reserved_sectors + br->dir_sectors + br->bitmap_sectors;
+}
+
+// Zera os cabeçalhos das duas metades do journal
+static int journal_limpar(int fd, const BootRecord *br) {
+    size_t bps = br->bytes_por_sector;
+    uint32_t metade = br->journal_sectors / 2;
+    unsigned char *zeros = (unsigned char *)calloc(bps, 1);
+    int r = 0;
+    for (uint32_t h = 0; h < 2 && r == 0; h++) {
+        r = escrever_em(fd, zeros, bps, offset_setor(br, journal_inicio(br) + h * metade));
+    }
+    free(zeros);
+    return r;
+}
+
+// Lê a transação da metade h; retorna o buffer (cabeçalho + imagens) se for válida
+static unsigned char *journal_ler_metade(int fd, const BootRecord *br, uint32_t h) {
+    size_t bps = br->bytes_por_sector;
+    uint32_t metade = br->journal_sectors / 2;
+    unsigned char *buf = (unsigned char *)malloc((size_t)metade * bps);
+    off_t off = offset_setor(br, journal_inicio(br) + h * metade);
+    if (!buf || ler_em(fd, buf, bps, off) != 0) {
+        free(buf);
+        return NULL;
+    }
+
+    JournalHeader hdr;
+    memcpy(&hdr, buf, sizeof(hdr));
+    uint64_t cabecalho = cabecalho_journal(bps, hdr.count);
+    if (memcmp(hdr.magic, JOURNAL_MAGIC, sizeof(hdr.magic)) != 0 || hdr.count == 0 ||
+        cabecalho + hdr.count > metade ||
+        ler_em(fd, buf + bps, (size_t)(cabecalho - 1 + hdr.count) * bps, off + (off_t)bps) != 0) {
+        free(buf);
+        return NULL;
+    }
+
+    // Transação incompleta (interrompida no meio da gravação) é descartada
+    uint32_t esperado = hdr.checksum;
+    memset(buf + offsetof(JournalHeader, checksum), 0, sizeof(hdr.checksum));
+    if (journal_checksum(buf, (size_t)(cabecalho + hdr.count) * bps, 2166136261u) != esperado) {
+        free(buf);
+        return NULL;
+    }
+    return buf;
+}
+
+// Reaplica as transações válidas do journal e o esvazia. Retorna a
+// quantidade de transações reaplicadas ou -1 em caso de erro.
+static int journal_reproduzir(int fd, const BootRecord *br) {
+    if (br->journal_sectors < 4) {
+        return 0;
+    }
+    size_t bps = br->bytes_por_sector;
+    unsigned char *metades[2] = {journal_ler_metade(fd, br, 0), journal_ler_metade(fd, br, 1)};
+    if (!metades[0] && !metades[1]) {
+        return 0;
+    }
+
+    // A transação mais antiga primeiro: a mais nova prevalece nos setores em comum
+    int ordem[2] = {0, 1};
+    if (metades[0] && metades[1] &&
+        ((JournalHeader *)metades[0])->seq > ((JournalHeader *)metades[1])->seq) {
+        ordem[0] = 1;
+        ordem[1] = 0;
+    }
+
+    int aplicadas = 0;
+    int r = 0;
+    for (int k = 0; k < 2 && r == 0; k++) {
+        unsigned char *buf = metades[ordem[k]];
+        if (!buf) continue;
+        JournalHeader hdr;
+        memcpy(&hdr, buf, sizeof(hdr));
+        const unsigned char *setores = buf + sizeof(JournalHeader);
+        const unsigned char *imagens = buf + cabecalho_journal(bps, hdr.count) * bps;
+        for (uint32_t i = 0; i < hdr.count && r == 0; i++) {
+            unsigned int setor;
+            memcpy(&setor, setores + i * sizeof(setor), sizeof(setor));
+            if (setor >= journal_inicio(br)) {
+                r = -1;
+                break;
+            }
+            r = escrever_em(fd, imagens + (size_t)i * bps, bps, offset_setor(br, setor));
+        }
+        aplicadas++;
+    }
+    free(metades[0]);
+    free(metades[1]);
+
+    if (r != 0 || fdatasync(fd) != 0 || journal_limpar(fd, br) != 0 || fdatasync(fd) != 0) {
+        perror("Erro ao reaplicar o journal");
+        return -1;
+    }
+    return aplicadas;
+}
+
+// Grava os setores sujos como uma transação na próxima metade do journal
+static int journal_gravar(Volume *vol) {
+    if (vol->dirty_count > vol->journal_cap) {
+        printf("Erro: Transação de %u setores maior que o journal (%u)\n", vol->dirty_count, vol->journal_cap);
+        return -1;
+    }
+    size_t bps = vol->bytes_per_sector;
+    size_t cabecalho = (size_t)cabecalho_journal(bps, vol->dirty_count);
+    size_t len = (cabecalho + vol->dirty_count) * bps;
+    unsigned char *buf = (unsigned char *)calloc(len, 1);
+    if (!buf) {
+        perror("Erro ao alocar memória para o journal");
+        return -1;
+    }
+
+    JournalHeader hdr;
+    memcpy(hdr.magic, JOURNAL_MAGIC, sizeof(hdr.magic));
+    hdr.count = vol->dirty_count;
+    hdr.seq = vol->journal_seq;
+    hdr.checksum = 0;
+    hdr.reserved = 0;
+
+    unsigned char *setores = buf + sizeof(JournalHeader);
+    uint32_t n = 0;
+    uint32_t s = bitmap_proximo(vol->meta_dirty, 0, vol->meta_sectors, 1);
+    while (s < vol->meta_sectors) {
+        memcpy(setores + n * sizeof(unsigned int), &s, sizeof(unsigned int));
+        memcpy(buf + (cabecalho + n) * bps, vol->meta + (size_t)s * bps, bps);
+        n++;
+        s = bitmap_proximo(vol->meta_dirty, s + 1, vol->meta_sectors, 1);
+    }
+    memcpy(buf, &hdr, sizeof(hdr));
+    hdr.checksum = journal_checksum(buf, len, 2166136261u);
+    memcpy(buf, &hdr, sizeof(hdr));
+
+    // Dados e blocos de extents gravados fora do cache (pwrite, io_uring,
+    // cópia no kernel, mmap) precisam estar no disco antes da transação que
+    // passa a referenciá-los
+    if (vol->barreira_dados && sincronizar_fd(vol->fd) != 0) {
+        perror("Erro ao gravar o journal");
+        free(buf);
+        return -1;
+    }
+
+    off_t off = offset_setor(vol->br, vol->journal_start + (vol->journal_seq % 2) * vol->journal_half);
+    int r = escrever_em(vol->fd, buf, len, off);
+    free(buf);
+    if (r != 0 || sincronizar_fd(vol->fd) != 0) {
+        perror("Erro ao gravar o journal");
+        return -1;
+    }
+    vol->journal_seq++;
+    vol->journal_usado = 1;
+    vol->barreira_dados = 0;
+    return 0;
+}
+
+// Índice de faixas livres, construído com uma passada pelo bitmap no
+// primeiro uso: operações que não alocam nem liberam (ls, export, df) não
+// pagam a varredura na montagem. As faixas liberadas na transação em curso
+// já estão livres no bitmap e ficam fora do índice até a confirmação (ver
+// liberar_setores). Sem memória retorna NULL.
+static FreeIndex *indice_livre(Volume *vol) {
+    if (!vol->indice_pronto) {
+        if (indice_construir(&vol->livres, vol->bitmap, vol->data_end - vol->data_start, vol->data_start) != 0) {
+            return NULL;
+        }
+        for (uint32_t i = 0; i < vol->liberados_qtd; i++) {
+            uint32_t s = vol->liberados[2 * i], n = vol->liberados[2 * i + 1];
+            FreeExtent *e = indice_anterior(&vol->livres, s);
+            if (e && e->start + e->count >= s + n && indice_ocupar(&vol->livres, e, s, n) != 0) {
+                indice_destruir(&vol->livres);
+                return NULL;
+            }
+        }
+        uint32_t dica = vol->br->alloc_hint;
+        if (dica >= vol->data_start && dica < vol->data_end) {
+            vol->livres.next_hint = dica;
+        }
+        vol->indice_pronto = 1;
+    }
+    return &vol->livres;
+}
+
+// Indica se o resumo do espaço livre do boot record pode ser usado
+static int resumo_valido(const BootRecord *br) {
+    return br->free_state == RESUMO_VALIDO &&
+           br->free_sectors <= br->data_sectors &&
+           br->largest_free_run <= br->free_sectors &&
+           br->alloc_hint >= br->first_free_sector &&
+           br->alloc_hint < br->first_free_sector + br->data_sectors;
+}
+
+// Recalcula o resumo a partir do bitmap (contagem por popcount, maior faixa
+// pelo índice). free_state continua inválido em memória, e o resumo é
+// gravado na próxima transação (ver atualizar_resumo).
+static int recalcular_resumo(Volume *vol) {
+    BootRecord *br = vol->br;
+    br->free_sectors = br->data_sectors - bitmap_contar_ocupados(vol->bitmap, 0, br->data_sectors);
+    br->alloc_hint = vol->data_start;
+    FreeIndex *idx = indice_livre(vol);
+    if (!idx) {
+        return -1;
+    }
+    br->largest_free_run = idx->by_start ? idx->by_start->max_count : 0;
+    br->free_state = RESUMO_SUJO;
+    return 0;
+}
+
+int montar_volume(Volume *vol, const char *disk_filename, const MountOptions *opts) {
+    memset(vol, 0, sizeof(Volume));
+
+    vol->fd = open(disk_filename, O_RDWR);
+    if (vol->fd < 0) {
+        perror("Erro ao abrir imagem do disco");
+        return -1;
+    }
+
+    // Lê e valida o boot record antes de dimensionar os metadados
+    BootRecord br;
+    if (ler_em(vol->fd, &br, sizeof(BootRecord), 0) != 0) {
+        perror("Erro ao ler boot record");
+        close(vol->fd);
+        memset(vol, 0, sizeof(Volume));
+        return -1;
+    }
+    uint64_t capacidade = capacidade_journal(br.dir_sectors, br.bitmap_sectors);
+    if (memcmp(br.magic, SA_MAGIC, sizeof(br.magic)) != 0 || br.version != SA_VERSION ||
+        br.bytes_por_sector < 512 ||
+        br.journal_sectors / 2 < cabecalho_journal(br.bytes_por_sector, capacidade) + capacidade) {
+        printf("Erro: Disco não formatado ou em formato incompatível (formate o disco novamente)\n");
+        close(vol->fd);
+        memset(vol, 0, sizeof(Volume));
+        return -1;
+    }
+
+    // Conclui as transações interrompidas; o boot record pode ter mudado
+    int reaplicadas = journal_reproduzir(vol->fd, &br);
+    if (reaplicadas < 0 || (reaplicadas > 0 && ler_em(vol->fd, &br, sizeof(BootRecord), 0) != 0)) {
+        close(vol->fd);
+        memset(vol, 0, sizeof(Volume));
+        return -1;
+    }
+    if (reaplicadas > 0) {
+        printf("Journal: %d transação(ões) reaplicada(s)\n", reaplicadas);
+    }
+
+    // Metadados ocupam os setores reservados, o diretório e o bitmap
+    size_t bps = br.bytes_por_sector;
+    uint32_t meta_sectors = journal_inicio(&br);
+    size_t meta_size = (size_t)meta_sectors * bps;
+    vol->meta_size = meta_size;
+    vol->backend = opts->backend;
+
+    // Os metadados ficam sempre em uma cópia privada: nem o backend mmap pode
+    // deixá-los chegar ao disco antes da transação do journal
+    vol->meta = (unsigned char *)malloc(meta_size);
+    if (!vol->meta) {
+        perror("Erro ao alocar memória para metadados");
+        close(vol->fd);
+        memset(vol, 0, sizeof(Volume));
+        return -1;
+    }
+
+    // Lê todos os metadados com uma única leitura
+    if (ler_em(vol->fd, vol->meta, meta_size, 0) != 0) {
+        perror("Erro ao ler metadados do disco");
+        free(vol->meta);
+        close(vol->fd);
+        memset(vol, 0, sizeof(Volume));
+        return -1;
+    }
+
+    if (vol->backend == BACKEND_MMAP) {
+        // Mapeia a imagem inteira para o caminho de dados
+        struct stat st;
+        uint64_t image_size = (uint64_t)br.total_sectors * bps;
+        if (fstat(vol->fd, &st) != 0 || (uint64_t)st.st_size < image_size) {
+            printf("Erro: Imagem do disco menor que o informado no boot record\n");
+            free(vol->meta);
+            close(vol->fd);
+            memset(vol, 0, sizeof(Volume));
+            return -1;
+        }
+        vol->map_size = (size_t)image_size;
+        vol->map = (unsigned char *)mmap(NULL, vol->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, vol->fd, 0);
+        if (vol->map == MAP_FAILED) {
+            perror("Erro ao mapear imagem do disco");
+            free(vol->meta);
+            close(vol->fd);
+            memset(vol, 0, sizeof(Volume));
+            return -1;
+        }
+    }
+
+    vol->br = (BootRecord *)vol->meta;
+    vol->dir = (DirEntry *)(vol->meta + br.reserved_sectors * bps);
+    vol->bitmap = vol->meta + ((size_t)br.reserved_sectors + br.dir_sectors) * bps;
+    vol->dir_entries = br.dir_entries;
+    vol->bitmap_size = br.bitmap_sectors * bps;
+
+    // Mapa de setores de metadados sujos (tamanho múltiplo de 8 para leitura por palavra)
+    vol->meta_sectors = meta_sectors;
+    vol->meta_dirty = (unsigned char *)calloc((vol->meta_sectors + 63) / 64, 8);
+    if (!vol->meta_dirty) {
+        perror("Erro ao alocar memória para metadados");
+        liberar_metadados(vol);
+        close(vol->fd);
+        memset(vol, 0, sizeof(Volume));
+        return -1;
+    }
+
+    // Journal: duas metades, cada uma com cabeçalho e até journal_cap imagens
+    vol->journal_start = meta_sectors;
+    vol->journal_half = br.journal_sectors / 2;
+    vol->journal_cap = (uint32_t)capacidade_journal(br.dir_sectors, br.bitmap_sectors);
+    vol->journal_seq = 1;
+
+    vol->bytes_per_sector = br.bytes_por_sector;
+    vol->sync_interval = opts->sync_interval;
+    vol->alloc_policy = opts->alloc_policy;
+    vol->io_engine = opts->io_engine;
+    vol->queue_depth = opts->queue_depth > 0 ? opts->queue_depth : 1;
+    vol->report = opts->report;
+    vol->threads = opts->threads > 0 ? opts->threads : 1;
+    pthread_mutex_init(&vol->trava_posicao, NULL);
+
+    // Buracos só desalocam blocos inteiros do sistema de arquivos do host
+    struct stat st_host;
+    vol->punch = opts->punch;
+    vol->setores_host = 1;
+    if (fstat(vol->fd, &st_host) == 0 && (uint64_t)st_host.st_blksize > bps) {
+        vol->setores_host = (uint32_t)(st_host.st_blksize / bps);
+    }
+
+    // Transferências em blocos inteiros, entre TRANSFER_SIZE_MIN e
+    // TRANSFER_SIZE_MAX: o tamanho sobe ao múltiplo seguinte do bloco e só
+    // desce se passar do máximo sem cair abaixo do mínimo (blocos que não
+    // dividem os limites, como 3 setores de 512 bytes)
+    size_t block_size = bps * (br.sectors_per_block ? br.sectors_per_block : 1);
+    size_t transfer = opts->transfer_size;
+    if (transfer < TRANSFER_SIZE_MIN) transfer = TRANSFER_SIZE_MIN;
+    if (transfer > TRANSFER_SIZE_MAX) transfer = TRANSFER_SIZE_MAX;
+    transfer = (transfer + block_size - 1) / block_size * block_size;
+    if (transfer > TRANSFER_SIZE_MAX && transfer - block_size >= TRANSFER_SIZE_MIN) {
+        transfer -= block_size;
+    }
+    vol->transfer_size = transfer;
+
+    vol->data_start = br.first_free_sector;
+    vol->data_end = vol->data_start + br.data_sectors;
+
+    // Resumo do espaço livre inválido: a imagem foi alterada por outro meio
+    // ou uma recontagem anterior não chegou a ser gravada
+    if (!resumo_valido(vol->br)) {
+        if (br.free_state != RESUMO_SUJO || br.free_sectors != 0) {
+            printf("Montagem: resumo do espaço livre inconsistente, recalculado a partir do bitmap\n");
+        }
+        if (recalcular_resumo(vol) != 0) {
+            free(vol->meta_dirty);
+            liberar_metadados(vol);
+            close(vol->fd);
+            memset(vol, 0, sizeof(Volume));
+            return -1;
+        }
+    }
+
+    // Indexa os nomes do diretório, as entradas livres e os fragmentos
+    vol->empacotar = opts->empacotar;
+    vol->comprimir = opts->comprimir;
+    if (dirindex_construir(&vol->nomes, vol->dir, vol->dir_entries) != 0 ||
+        frag_construir(&vol->fragmentos, vol->dir, vol->dir_entries, bps, vol->data_start, vol->data_end) != 0) {
+        dirindex_destruir(&vol->nomes);
+        indice_destruir(&vol->livres);
+        free(vol->meta_dirty);
+        liberar_metadados(vol);
+        close(vol->fd);
+        memset(vol, 0, sizeof(Volume));
+        return -1;
+    }
+
+    // No backend mmap o cache de páginas do kernel já atende as leituras repetidas
+    size_t cache_size = vol->backend == BACKEND_STDIO ? opts->cache_size : 0;
+    if (cache_criar(&vol->cache, cache_size, bps, br.sectors_per_block, (uint64_t)br.total_sectors * bps) != 0) {
+        cache_criar(&vol->cache, 0, bps, 1, 0);
+    }
+    return 0;
+}
+
+// Marca como sujos os setores de metadados que cobrem [off, off + len) de meta
+static void marcar_meta_sujo(Volume *vol, size_t off, size_t len) {
+    if (len == 0) {
+        return;
+    }
+    uint32_t primeiro = (uint32_t)(off / vol->bytes_per_sector);
+    uint32_t ultimo = (uint32_t)((off + len - 1) / vol->bytes_per_sector);
+    uint32_t n = ultimo - primeiro + 1;
+    uint32_t ja_sujos = bitmap_contar_ocupados(vol->meta_dirty, primeiro, primeiro + n);
+    bitmap_marcar(vol->meta_dirty, primeiro, n, 1);
+    vol->dirty_count += n - ja_sujos;
+}
+
+static void marcar_boot_sujo(Volume *vol) {
+    marcar_meta_sujo(vol, 0, sizeof(BootRecord));
+}
+
+static void marcar_entrada_suja(Volume *vol, int i) {
+    marcar_meta_sujo(vol, (unsigned char *)&vol->dir[i] - vol->meta, sizeof(DirEntry));
+}
+
+// Altera os bits dos setores [inicio, inicio + n) da área de dados no bitmap
+static void marcar_bitmap(Volume *vol, uint32_t inicio, uint32_t n, int ocupado) {
+    if (ocupado) {
+        ESTAT(setores_alocados, n);
+        vol->br->free_sectors -= n;
+    } else {
+        ESTAT(setores_liberados, n);
+        vol->br->free_sectors += n;
+    }
+    marcar_boot_sujo(vol);
+    uint32_t rel = inicio - vol->data_start;
+    bitmap_marcar(vol->bitmap, rel, n, ocupado);
+
+    // Sujeira registrada pelas palavras de 64 bits tocadas
+    size_t primeira = rel / 64;
+    size_t ultima = ((size_t)rel + n - 1) / 64;
+    marcar_meta_sujo(vol, (vol->bitmap - vol->meta) + primeira * 8, (ultima - primeira + 1) * 8);
+}
+
+// Aloca n setores contíguos segundo a política do volume e os marca no bitmap
+static int alocar_setores(Volume *vol, uint32_t n, uint32_t *inicio) {
+    FreeIndex *idx = indice_livre(vol);
+    if (!idx) {
+        return -1;
+    }
+    FreeExtent *e = NULL;
+
+    switch (vol->alloc_policy) {
+        case ALOC_BEST_FIT:
+            e = buscar_best_fit(idx->by_size, n);
+            break;
+        case ALOC_NEXT_FIT:
+            e = buscar_a_partir(idx->by_start, n, idx->next_hint);
+            if (!e) e = buscar_first_fit(idx->by_start, n);
+            break;
+        default:
+            e = buscar_first_fit(idx->by_start, n);
+    }
+
+    if (!e) {
+        return -1;
+    }
+
+    *inicio = e->start;
+    if (indice_ocupar(idx, e, *inicio, n) != 0) {
+        return -1;
+    }
+    idx->next_hint = *inicio + n;
+    marcar_bitmap(vol, *inicio, n, 1);
+    return 0;
+}
+
+// Ocupa até n setores livres a partir de 'inicio' (em geral logo após o
+// último extent de um arquivo, para crescer no lugar); retorna quantos
+static uint32_t estender_setores(Volume *vol, uint32_t inicio, uint32_t n) {
+    FreeIndex *idx = indice_livre(vol);
+    if (!idx) {
+        return 0;
+    }
+    FreeExtent *e = indice_anterior(idx, inicio);
+    ESTAT(passos_alocador, 1);
+    if (!e || e->start != inicio || n == 0) {
+        return 0;
+    }
+    uint32_t take = e->count < n ? e->count : n;
+    if (indice_ocupar(idx, e, inicio, take) != 0) {
+        return 0;
+    }
+    marcar_bitmap(vol, inicio, take, 1);
+    return take;
+}
+
+// Acrescenta um registro de k valores a uma lista que dobra de capacidade
+static int anotar_registro(uint32_t **lista, uint32_t *qtd, uint32_t *cap, const uint32_t *valores, uint32_t k) {
+    if (*qtd == *cap) {
+        uint32_t maior = *cap ? *cap * 2 : 64;
+        uint32_t *novo = (uint32_t *)realloc(*lista, (size_t)maior * k * sizeof(uint32_t));
+        if (!novo) {
+            return -1;
+        }
+        *lista = novo;
+        *cap = maior;
+    }
+    memcpy(*lista + (size_t)*qtd * k, valores, k * sizeof(uint32_t));
+    (*qtd)++;
+    return 0;
+}
+
+// Libera n setores a partir de inicio no bitmap. A faixa só volta ao índice
+// de faixas livres depois da transação que confirma a liberação (ver
+// devolver_liberados): antes disso uma queda deixaria a entrada antiga
+// apontando para setores já regravados por outro arquivo.
+static void liberar_setores(Volume *vol, uint32_t inicio, uint32_t n) {
+    if (n == 0) {
+        return;
+    }
+    // O índice é montado antes de o bitmap mudar; se não houver memória
+    // agora, a construção posterior retira as faixas registradas abaixo
+    indice_livre(vol);
+    marcar_bitmap(vol, inicio, n, 0);
+
+    // Sem memória para o registro a faixa fica fora do índice até a
+    // próxima montagem
+    uint32_t faixa[2] = {inicio, n};
+    anotar_registro(&vol->liberados, &vol->liberados_qtd, &vol->liberados_cap, faixa, 2);
+}
+
+// Lê len bytes da imagem a partir de off, pelo backend do volume
+static int disco_ler(Volume *vol, void *buf, size_t len, off_t off) {
+    if (vol->backend == BACKEND_MMAP) {
+        if ((uint64_t)off + len > vol->map_size) {
+            errno = EIO;
+            return -1;
+        }
+        memcpy(buf, vol->map + off, len);
+        return 0;
+    }
+    if (vol->cache.quantidade > 0) {
+        return cache_ler(&vol->cache, vol->fd, buf, len, off);
+    }
+    return ler_em(vol->fd, buf, len, off);
+}
+
+// Escreve len bytes na imagem a partir de off, pelo backend do volume. Com
+// 'novo' o restante do último setor não guarda dados (ver cache_escrever).
+static int disco_escrever(Volume *vol, const void *buf, size_t len, off_t off, int novo) {
+    if (vol->backend == BACKEND_MMAP) {
+        if ((uint64_t)off + len > vol->map_size) {
+            errno = EIO;
+            return -1;
+        }
+        memcpy(vol->map + off, buf, len);
+        return 0;
+    }
+    if (vol->cache.quantidade > 0) {
+        return cache_escrever(&vol->cache, vol->fd, buf, len, off, novo);
+    }
+    return escrever_em(vol->fd, buf, len, off);
+}
+
+// ---------------------------------------------------------------------------
+// Extents de arquivos
+//
+// Cada arquivo é uma lista de faixas contíguas (extents). As primeiras
+// INLINE_EXTENTS ficam na própria entrada do diretório; as demais ficam em
+// blocos de extents (um setor cada) encadeados a partir de overflow_sector.
+// ---------------------------------------------------------------------------
+
+// Quantidade de extents que cabem em um bloco de extents
+static inline uint32_t extents_por_bloco(const Volume *vol) {
+    return (vol->bytes_per_sector - sizeof(ExtentBlockHeader)) / sizeof(FileExtent);
+}
+
+// Maior faixa livre (última da árvore por tamanho)
+static FreeExtent *buscar_maior(FreeExtent *t) {
+    uint64_t passos = 1;
+    while (t && t->sright) {
+        t = t->sright;
+        passos++;
+    }
+    ESTAT(passos_alocador, passos);
+    return t;
+}
+
+// Reserva n setores: em uma única faixa quando possível, senão em várias
+// faixas começando pelas maiores. Devolve a lista alocada em *lista.
+static int alocar_extents(Volume *vol, uint32_t n, FileExtent **lista, uint32_t *qtd) {
+    *lista = NULL;
+    *qtd = 0;
+    if (n == 0) {
+        return 0;
+    }
+    if (vol->br->free_sectors < n) {
+        return -1;
+    }
+
+    uint32_t capacidade = 16;
+    FileExtent *ext = (FileExtent *)malloc(capacidade * sizeof(FileExtent));
+    if (!ext) {
+        return -1;
+    }
+    uint32_t start;
+    if (alocar_setores(vol, n, &start) == 0) {
+        ext[0].start = start;
+        ext[0].count = n;
+        *lista = ext;
+        *qtd = 1;
+        return 0;
+    }
+
+    uint32_t total = 0;
+    while (n > 0) {
+        FreeIndex *idx = indice_livre(vol);
+        FreeExtent *e = idx ? buscar_maior(idx->by_size) : NULL;
+        FileExtent *maior = ext;
+        if (e && total == capacidade) {
+            maior = (FileExtent *)realloc(ext, capacidade * 2 * sizeof(FileExtent));
+            if (maior) {
+                ext = maior;
+                capacidade *= 2;
+            }
+        }
+        uint32_t take = e && e->count < n ? e->count : n;
+        start = e ? e->start : 0;
+        if (!e || !maior || total == MAX_EXTENTS || indice_ocupar(idx, e, start, take) != 0) {
+            // Desfaz a alocação parcial
+            for (uint32_t i = 0; i < total; i++) {
+                liberar_setores(vol, ext[i].start, ext[i].count);
+            }
+            free(ext);
+            return -1;
+        }
+        marcar_bitmap(vol, start, take, 1);
+        ext[total].start = start;
+        ext[total].count = take;
+        total++;
+        n -= take;
+    }
+
+    *lista = ext;
+    *qtd = total;
+    return 0;
+}
+
+// Acrescenta 'novos' ao fim da lista (com espaço para eles), unindo faixas
+// adjacentes; retorna a nova quantidade
+static uint32_t anexar_extents(FileExtent *lista, uint32_t qtd, const FileExtent *novos, uint32_t n) {
+    for (uint32_t e = 0; e < n; e++) {
+        if (qtd > 0 && lista[qtd - 1].start + lista[qtd - 1].count == novos[e].start) {
+            lista[qtd - 1].count += novos[e].count;
+        } else {
+            lista[qtd++] = novos[e];
+        }
+    }
+    return qtd;
+}
+
+// Mantém os primeiros 'setores' setores da lista e devolve o restante ao
+// bitmap; *qtd passa a ser a quantidade de extents que sobraram
+static void cortar_extents(Volume *vol, FileExtent *lista, uint32_t *qtd, uint64_t setores) {
+    uint64_t acumulado = 0;
+    uint32_t ficam = 0;
+    for (uint32_t e = 0; e < *qtd; e++) {
+        FileExtent x = lista[e];
+        uint32_t fica = acumulado >= setores ? 0
+                      : setores - acumulado < x.count ? (uint32_t)(setores - acumulado) : x.count;
+        acumulado += x.count;
+        liberar_setores(vol, x.start + fica, x.count - fica);
+        if (fica > 0) {
+            lista[ficam].start = x.start;
+            lista[ficam++].count = fica;
+        }
+    }
+    *qtd = ficam;
+}
+
+// Indica se os últimos 'cauda' bytes de um arquivo de 'size' bytes vão para
+// um setor de fragmentos: arquivos menores que um setor e caudas de até
+// meio setor (acima disso a economia não paga a leitura extra)
+static int empacotar_cauda(const Volume *vol, uint64_t size, uint32_t cauda) {
+    return vol->empacotar && cauda > 0 && (size < vol->bytes_per_sector || cauda <= vol->bytes_per_sector / 2);
+}
+
+// Reserva 'bytes' bytes (menos que um setor) em um setor de fragmentos:
+// primeiro no setor da última cauda, depois em até FRAG_SONDAGENS setores
+// da tabela e, se nenhum tiver espaço, em um setor novo
+static int alocar_fragmento(Volume *vol, uint32_t bytes, uint32_t *setor, uint32_t *offset) {
+    FragIndex *idx = &vol->fragmentos;
+    uint32_t bps = vol->bytes_per_sector;
+    uint32_t unidade = bps / FRAG_UNIDADES;
+    uint32_t n = (bytes + unidade - 1) / unidade;
+
+    SetorFragmentos *f = idx->corrente ? frag_buscar(idx, idx->corrente) : NULL;
+    int pos = f ? frag_procurar(f->mapa, n) : -1;
+    for (uint32_t i = 0; pos < 0 && idx->tabela && i < FRAG_SONDAGENS && i <= idx->mask; i++) {
+        SetorFragmentos *c = &idx->tabela[idx->cursor];
+        idx->cursor = (idx->cursor + 1) & idx->mask;
+        if (c->setor != 0 && (pos = frag_procurar(c->mapa, n)) >= 0) {
+            f = c;
+        }
+    }
+    ESTAT(passos_alocador, 1);
+    if (pos < 0) {
+        uint32_t novo;
+        if (alocar_setores(vol, 1, &novo) != 0) {
+            return -1;
+        }
+        if (!(f = frag_inserir(idx, novo))) {
+            liberar_setores(vol, novo, 1);
+            return -1;
+        }
+        pos = 0;
+    }
+
+    *setor = f->setor;
+    *offset = (uint32_t)pos * unidade;
+    f->mapa |= frag_mascara(bps, *offset, bytes);
+    idx->corrente = f->setor;
+    return 0;
+}
+
+// Devolve a cauda ao seu setor de fragmentos; o setor vazio volta ao bitmap
+static void soltar_fragmento(Volume *vol, uint32_t setor, uint32_t offset, uint32_t bytes) {
+    SetorFragmentos *f = frag_buscar(&vol->fragmentos, setor);
+    if (!f) {
+        return;
+    }
+    f->mapa &= ~frag_mascara(vol->bytes_per_sector, offset, bytes);
+    if (f->mapa == 0) {
+        frag_remover(&vol->fragmentos, setor);
+        liberar_setores(vol, setor, 1);
+    }
+}
+
+// Libera a cauda; como os setores, o espaço só pode receber outra cauda
+// depois da transação que confirma a liberação
+static void liberar_fragmento(Volume *vol, uint32_t setor, uint32_t offset, uint32_t bytes) {
+    uint32_t cauda[3] = {setor, offset, bytes};
+    anotar_registro(&vol->caudas_liberadas, &vol->caudas_qtd, &vol->caudas_cap, cauda, 3);
+}
+
+// Carrega todos os extents do arquivo (inline e blocos de extents)
+static int carregar_extents(Volume *vol, const DirEntry *entry, FileExtent **lista, uint32_t *qtd) {
+    uint32_t n = entry->extent_count;
+    *qtd = 0;
+    *lista = (FileExtent *)malloc((n ? n : 1) * sizeof(FileExtent));
+    if (!*lista) {
+        perror("Erro ao alocar memória para extents");
+        return -1;
+    }
+
+    uint32_t inline_n = n < INLINE_EXTENTS ? n : INLINE_EXTENTS;
+    memcpy(*lista, entry->extents, inline_n * sizeof(FileExtent));
+    uint32_t total = inline_n;
+
+    size_t bps = vol->bytes_per_sector;
+    unsigned char *bloco = NULL;
+    uint32_t setor = entry->overflow_sector;
+    while (total < n && setor != 0) {
+        if (!bloco) bloco = (unsigned char *)malloc(bps);
+        if (!bloco || disco_ler(vol, bloco, bps, offset_setor(vol->br, setor)) != 0) {
+            perror(bloco ? "Erro ao ler bloco de extents" : "Erro ao alocar memória para extents");
+            free(bloco);
+            free(*lista);
+            *lista = NULL;
+            return -1;
+        }
+        ExtentBlockHeader *hdr = (ExtentBlockHeader *)bloco;
+        uint32_t k = hdr->count;
+        if (k > n - total) k = n - total;
+        memcpy(*lista + total, bloco + sizeof(ExtentBlockHeader), k * sizeof(FileExtent));
+        total += k;
+        setor = hdr->next_sector;
+    }
+    free(bloco);
+
+    if (total != n) {
+        printf("Erro: Lista de extents corrompida\n");
+        free(*lista);
+        *lista = NULL;
+        return -1;
+    }
+    *qtd = n;
+    return 0;
+}
+
+// Setores ocupados pelos blocos de extents do arquivo
+static int carregar_blocos_overflow(Volume *vol, const DirEntry *entry, uint32_t **setores, uint32_t *qtd) {
+    uint32_t extras = entry->extent_count > INLINE_EXTENTS ? entry->extent_count - INLINE_EXTENTS : 0;
+    uint32_t por_bloco = extents_por_bloco(vol);
+    uint32_t n = (extras + por_bloco - 1) / por_bloco;
+    *qtd = 0;
+    *setores = (uint32_t *)malloc((n ? n : 1) * sizeof(uint32_t));
+    if (!*setores) {
+        perror("Erro ao alocar memória para blocos de extents");
+        return -1;
+    }
+
+    ExtentBlockHeader hdr;
+    uint32_t setor = entry->overflow_sector;
+    while (*qtd < n && setor != 0) {
+        (*setores)[(*qtd)++] = setor;
+        if (disco_ler(vol, &hdr, sizeof(hdr), offset_setor(vol->br, setor)) != 0) {
+            perror("Erro ao ler bloco de extents");
+            return -1;
+        }
+        setor = hdr.next_sector;
+    }
+    return 0;
+}
+
+// Grava a lista de extents na entrada, alocando e escrevendo os blocos de
+// extents necessários. Em caso de erro nada fica alocado.
+static int gravar_extents(Volume *vol, DirEntry *entry, const FileExtent *lista, uint32_t qtd) {
+    memset(entry->extents, 0, sizeof(entry->extents));
+    uint32_t inline_n = qtd < INLINE_EXTENTS ? qtd : INLINE_EXTENTS;
+    if (inline_n) {
+        memcpy(entry->extents, lista, inline_n * sizeof(FileExtent));
+    }
+    entry->extent_count = (unsigned short)qtd;
+    entry->first_sector = qtd ? lista[0].start : 0;
+    entry->overflow_sector = 0;
+    if (qtd <= INLINE_EXTENTS) {
+        return 0;
+    }
+
+    size_t bps = vol->bytes_per_sector;
+    uint32_t por_bloco = extents_por_bloco(vol);
+    uint32_t extras = qtd - INLINE_EXTENTS;
+    uint32_t n_blocos = (extras + por_bloco - 1) / por_bloco;
+    uint32_t *setores = (uint32_t *)malloc(n_blocos * sizeof(uint32_t));
+    unsigned char *bloco = (unsigned char *)malloc(bps);
+    if (!setores || !bloco) {
+        perror("Erro ao alocar memória para blocos de extents");
+        free(bloco);
+        free(setores);
+        return -1;
+    }
+    for (uint32_t b = 0; b < n_blocos; b++) {
+        if (alocar_setores(vol, 1, &setores[b]) != 0) {
+            for (uint32_t i = 0; i < b; i++) {
+                liberar_setores(vol, setores[i], 1);
+            }
+            free(bloco);
+            free(setores);
+            return -1;
+        }
+    }
+
+    // Cada bloco aponta para o seguinte; o último tem next_sector = 0
+    for (uint32_t b = 0; b < n_blocos; b++) {
+        uint32_t inicio = INLINE_EXTENTS + b * por_bloco;
+        uint32_t k = (qtd - inicio) < por_bloco ? (qtd - inicio) : por_bloco;
+        memset(bloco, 0, bps);
+        ExtentBlockHeader *hdr = (ExtentBlockHeader *)bloco;
+        hdr->next_sector = (b + 1 < n_blocos) ? setores[b + 1] : 0;
+        hdr->count = k;
+        memcpy(bloco + sizeof(ExtentBlockHeader), lista + inicio, k * sizeof(FileExtent));
+        if (disco_escrever(vol, bloco, bps, offset_setor(vol->br, setores[b]), 1) != 0) {
+            perror("Erro ao gravar bloco de extents");
+            for (uint32_t i = 0; i < n_blocos; i++) {
+                liberar_setores(vol, setores[i], 1);
+            }
+            free(bloco);
+            free(setores);
+            return -1;
+        }
+    }
+    free(bloco);
+    vol->barreira_dados = 1;
+
+    entry->overflow_sector = setores[0];
+    free(setores);
+    return 0;
+}
+
+// Libera todos os setores do arquivo: dados, blocos de extents e cauda
+static int liberar_arquivo(Volume *vol, const DirEntry *entry) {
+    FileExtent *lista;
+    uint32_t qtd;
+    uint32_t *blocos;
+    uint32_t n_blocos;
+    if (carregar_extents(vol, entry, &lista, &qtd) != 0) {
+        return -1;
+    }
+    if (carregar_blocos_overflow(vol, entry, &blocos, &n_blocos) != 0) {
+        free(blocos);
+        free(lista);
+        return -1;
+    }
+    for (uint32_t i = 0; i < qtd; i++) {
+        liberar_setores(vol, lista[i].start, lista[i].count);
+    }
+    for (uint32_t i = 0; i < n_blocos; i++) {
+        liberar_setores(vol, blocos[i], 1);
+    }
+    if (entry->attributes & ATRIB_CAUDA) {
+        liberar_fragmento(vol, entry->tail_sector, entry->tail_offset, entry->tail_length);
+    }
+    free(blocos);
+    free(lista);
+    return 0;
+}
+
+// Substitui a lista de extents da entrada i, liberando os blocos de extents
+// anteriores (os setores de dados que saíram da lista ficam com quem chama).
+// Em caso de erro a entrada fica como estava.
+static int substituir_extents(Volume *vol, int i, const FileExtent *lista, uint32_t qtd) {
+    uint32_t *blocos;
+    uint32_t n_blocos;
+    DirEntry anterior = vol->dir[i];
+    if (carregar_blocos_overflow(vol, &anterior, &blocos, &n_blocos) != 0) {
+        free(blocos);
+        return -1;
+    }
+    if (gravar_extents(vol, &vol->dir[i], lista, qtd) != 0) {
+        vol->dir[i] = anterior;
+        free(blocos);
+        return -1;
+    }
+    marcar_entrada_suja(vol, i);
+    for (uint32_t b = 0; b < n_blocos; b++) {
+        liberar_setores(vol, blocos[b], 1);
+    }
+    free(blocos);
+    return 0;
+}
+
+// Próxima faixa de setores sujos a partir de *pos, unindo faixas separadas
+// por até META_GAP_MAX setores limpos. Retorna 0 quando não há mais faixas.
+static int proxima_faixa_suja(const Volume *vol, uint32_t *pos, uint32_t *inicio, uint32_t *fim) {
+    uint32_t n = vol->meta_sectors;
+    uint32_t s = bitmap_proximo(vol->meta_dirty, *pos, n, 1);
+    if (s >= n) {
+        return 0;
+    }
+    uint32_t e = bitmap_proximo(vol->meta_dirty, s, n, 0);
+    while (e < n) {
+        uint32_t prox = bitmap_proximo(vol->meta_dirty, e, n, 1);
+        if (prox >= n || prox - e > META_GAP_MAX) break;
+        e = bitmap_proximo(vol->meta_dirty, prox, n, 0);
+    }
+    *inicio = s;
+    *fim = e;
+    *pos = e;
+    return 1;
+}
+
+// ---------------------------------------------------------------------------
+// Devolução de espaço ao host
+//
+// Setores liberados só voltam a ser alocáveis depois que a transação que os
+// libera está no disco; nesse momento também são desalocados da imagem com
+// FALLOC_FL_PUNCH_HOLE, em blocos inteiros do sistema de arquivos do host,
+// e apenas nos setores livres no bitmap. Uma queda antes disso preserva os
+// dados dos arquivos cuja remoção não foi confirmada.
+// ---------------------------------------------------------------------------
+
+// Indica se os setores [inicio, fim) da área de dados estão todos livres
+static int setores_livres(const Volume *vol, uint32_t inicio, uint32_t fim) {
+    if (inicio < vol->data_start || fim > vol->data_end) {
+        return 0;
+    }
+    return bitmap_contar_ocupados(vol->bitmap, inicio - vol->data_start, fim - vol->data_start) == 0;
+}
+
+// Desaloca no host os setores livres [inicio, fim). As pontas avançam até o
+// limite do bloco do host quando os setores vizinhos também estão livres e
+// recuam para dentro da faixa caso contrário. Retorna os bytes desalocados.
+static uint64_t abrir_buraco(Volume *vol, uint32_t inicio, uint32_t fim) {
+    uint32_t g = vol->setores_host;
+    uint32_t a = inicio - inicio % g;
+    if (a < inicio && !setores_livres(vol, a, inicio)) {
+        a += g;
+    }
+    uint32_t b = fim % g ? fim - fim % g + g : fim;
+    if (b > fim && !setores_livres(vol, fim, b)) {
+        b -= g;
+    }
+    if (!vol->punch || b <= a) {
+        return 0;
+    }
+
+    off_t off = offset_setor(vol->br, a);
+    uint64_t len = (uint64_t)(b - a) * vol->bytes_per_sector;
+    cache_contornar(&vol->cache, vol->fd, off, len, 1);
+    if (fallocate(vol->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, off, (off_t)len) != 0) {
+        if (errno == EOPNOTSUPP || errno == ENOSYS) {
+            printf("Aviso: O sistema de arquivos do host não suporta buracos; espaço liberado não será devolvido\n");
+            vol->punch = 0;
+        }
+        return 0;
+    }
+    vol->bytes_devolvidos += len;
+    return len;
+}
+
+// Desaloca todas as faixas livres contidas em [inicio, fim)
+static uint64_t abrir_buracos_em(Volume *vol, uint32_t inicio, uint32_t fim) {
+    uint32_t base = vol->data_start;
+    uint32_t n = fim - base;
+    uint64_t total = 0;
+    uint32_t s = bitmap_proximo(vol->bitmap, inicio - base, n, 0);
+    while (s < n && vol->punch) {
+        uint32_t e = bitmap_proximo(vol->bitmap, s, n, 1);
+        total += abrir_buraco(vol, base + s, base + e);
+        s = bitmap_proximo(vol->bitmap, e, n, 0);
+    }
+    return total;
+}
+
+static int comparar_faixas(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+// Devolve ao índice as faixas e caudas liberadas na transação confirmada e
+// desaloca as faixas no host, unindo as vizinhas. Um setor de fragmentos
+// que fica vazio é liberado para a transação seguinte.
+static void devolver_liberados(Volume *vol) {
+    uint32_t *c = vol->caudas_liberadas;
+    uint32_t n_caudas = vol->caudas_qtd;
+    vol->caudas_qtd = 0;
+    uint32_t *f = vol->liberados;
+    uint32_t qtd = vol->liberados_qtd;
+    vol->liberados_qtd = 0;
+    // Sem memória para um nó o índice é descartado e refeito do bitmap no
+    // próximo uso, quando todas essas faixas já constam como livres
+    for (uint32_t i = 0; i < qtd && vol->indice_pronto; i++) {
+        if (indice_devolver(&vol->livres, f[2 * i], f[2 * i + 1]) != 0) {
+            indice_destruir(&vol->livres);
+            vol->indice_pronto = 0;
+        }
+    }
+    if (qtd > 0 && vol->punch) {
+        qsort(f, qtd, 2 * sizeof(uint32_t), comparar_faixas);
+        uint32_t inicio = f[0], fim = f[0] + f[1];
+        for (uint32_t i = 1; i < qtd; i++) {
+            if (f[2 * i] <= fim) {
+                if (f[2 * i] + f[2 * i + 1] > fim) fim = f[2 * i] + f[2 * i + 1];
+                continue;
+            }
+            abrir_buracos_em(vol, inicio, fim);
+            inicio = f[2 * i];
+            fim = f[2 * i] + f[2 * i + 1];
+        }
+        abrir_buracos_em(vol, inicio, fim);
+    }
+    for (uint32_t i = 0; i < n_caudas; i++) {
+        soltar_fragmento(vol, c[3 * i], c[3 * i + 1], c[3 * i + 2]);
+    }
+}
+
+// Leva a maior faixa livre e a dica de alocação do índice ao boot record
+// (setores livres já são mantidos por marcar_bitmap), na mesma transação
+// que as alterações do bitmap
+static void atualizar_resumo(Volume *vol) {
+    BootRecord *br = vol->br;
+    if (vol->indice_pronto) {
+        uint32_t maior = vol->livres.by_start ? vol->livres.by_start->max_count : 0;
+        uint32_t dica = vol->livres.next_hint < vol->data_end ? vol->livres.next_hint : vol->data_start;
+        if (br->largest_free_run != maior || br->alloc_hint != dica) {
+            br->largest_free_run = maior;
+            br->alloc_hint = dica;
+            marcar_boot_sujo(vol);
+        }
+    }
+    if (br->free_state != RESUMO_VALIDO) {
+        br->free_state = RESUMO_VALIDO;
+        marcar_boot_sujo(vol);
+    }
+}
+
+// Grava no disco apenas os setores de metadados alterados, como uma
+// transação do journal: faixas sujas próximas são unidas e cada faixa
+// resultante vai em uma única escrita no lugar definitivo. O tempo gasto
+// descarregando o cache de dados é devolvido em *ns_dados.
+static int gravar_transacao(Volume *vol, uint64_t *ns_dados) {
+    // Dados em cache vão para o disco antes da transação que os referencia
+    uint64_t inicio_cache = agora_ns();
+    int gravados = cache_descarregar(&vol->cache, vol->fd);
+    *ns_dados = agora_ns() - inicio_cache;
+    if (gravados < 0) {
+        perror("Erro ao gravar o cache de blocos");
+        return -1;
+    }
+    if (gravados > 0) {
+        vol->barreira_dados = 1;
+    }
+    atualizar_resumo(vol);
+    if (vol->dirty_count == 0) {
+        vol->pending_ops = 0;
+        devolver_liberados(vol);
+        return 0;
+    }
+
+    if (journal_gravar(vol) != 0) {
+        return -1;
+    }
+
+    size_t bps = vol->bytes_per_sector;
+    uint32_t pos = 0, inicio, fim;
+    while (proxima_faixa_suja(vol, &pos, &inicio, &fim)) {
+        size_t off = (size_t)inicio * bps;
+        size_t len = (size_t)(fim - inicio) * bps;
+        if (escrever_em(vol->fd, vol->meta + off, len, (off_t)off) != 0) {
+            perror("Erro ao atualizar metadados");
+            return -1;
+        }
+    }
+
+    memset(vol->meta_dirty, 0, (vol->meta_sectors + 63) / 64 * 8);
+    vol->dirty_count = 0;
+    vol->pending_ops = 0;
+
+    // Com a transação durável, os setores liberados voltam a ser alocáveis
+    devolver_liberados(vol);
+    return 0;
+}
+
+int sincronizar_volume(Volume *vol) {
+    if (!vol->meta) {
+        return -1;
+    }
+
+    // Dentro de outra operação o tempo é somado a ela; fora, a sincronização
+    // é medida como operação própria
+    EstatEscopo e;
+    int propria = estat_corrente == NULL;
+    if (propria) {
+        estat_iniciar(&e, &vol->estat[OP_SINCRONIZACAO], 0);
+    }
+    uint64_t inicio = agora_ns(), ns_cache = 0;
+    int r = gravar_transacao(vol, &ns_cache);
+    ESTAT(ns_dados, ns_cache);
+    ESTAT(ns_metadados, agora_ns() - inicio - ns_cache);
+    return propria ? estat_concluir(&e, r) : r;
+}
+
+// Como alocar_extents; sem espaço enquanto há setores liberados na transação
+// em andamento, confirma a transação para que voltem a ser alocáveis e
+// tenta de novo
+static int alocar_extents_confirmando(Volume *vol, uint32_t n, FileExtent **lista, uint32_t *qtd) {
+    if (alocar_extents(vol, n, lista, qtd) == 0) {
+        return 0;
+    }
+    if (vol->liberados_qtd == 0 || sincronizar_volume(vol) != 0) {
+        return -1;
+    }
+    return alocar_extents(vol, n, lista, qtd);
+}
+
+// Registra o fim de uma operação que alterou metadados. As operações são
+// agrupadas em uma transação até atingir o intervalo configurado ou metade
+// da capacidade do journal.
+static void operacao_concluida(Volume *vol) {
+    vol->pending_ops++;
+    if ((vol->sync_interval > 0 && vol->pending_ops >= vol->sync_interval) ||
+        (vol->journal_cap > 0 && vol->dirty_count > vol->journal_cap / 2)) {
+        sincronizar_volume(vol);
+    }
+}
+
+void desmontar_volume(Volume *vol) {
+    if (!vol->meta) {
+        return;
+    }
+
+    // Com as escritas no lugar duráveis, o journal pode ser esvaziado
+    if (sincronizar_volume(vol) == 0 && vol->journal_usado && sincronizar_fd(vol->fd) == 0) {
+        journal_limpar(vol->fd, vol->br);
+    }
+    indice_destruir(&vol->livres);
+    dirindex_destruir(&vol->nomes);
+    frag_destruir(&vol->fragmentos);
+    free(vol->meta_dirty);
+    free(vol->liberados);
+    free(vol->caudas_liberadas);
+    liberar_metadados(vol);
+    cache_destruir(&vol->cache);
+    pthread_mutex_destroy(&vol->trava_posicao);
+    close(vol->fd);
+    memset(vol, 0, sizeof(Volume));
+}
+
+// Volume desmontado, para montar_volume; liberado com volume_destruir
+Volume *volume_criar(void) {
+    return (Volume *)calloc(1, sizeof(Volume));
+}
+
+void volume_destruir(Volume *vol) {
+    if (vol) {
+        desmontar_volume(vol);
+        free(vol);
+    }
+}
+
+int volume_montado(const Volume *vol) {
+    if (!vol->meta) {
+        printf("Erro: Disco não montado (formate o disco primeiro)\n");
+        return 0;
+    }
+    return 1;
+}
+
+// Espaço ocupado pela imagem no host, em bytes
+static uint64_t ocupacao_host(int fd) {
+    struct stat st;
+    return fstat(fd, &st) == 0 ? (uint64_t)st.st_blocks * 512 : 0;
+}
+
+// Desaloca no host todas as faixas livres do bitmap (trim), inclusive as
+// liberadas por versões que não abriam buracos
+int aparar_volume(Volume *vol) {
+    if (!volume_montado(vol) || sincronizar_volume(vol) != 0) {
+        return -1;
+    }
+    if (!vol->punch) {
+        printf("Aviso: Devolução de espaço ao host desativada\n");
+        return -1;
+    }
+    uint64_t antes = ocupacao_host(vol->fd);
+    uint64_t bytes = abrir_buracos_em(vol, vol->data_start, vol->data_end);
+    if (!vol->punch) {
+        return -1;
+    }
+    uint64_t depois = ocupacao_host(vol->fd);
+    printf("Trim: %llu KB de faixas livres desalocados; imagem ocupa %llu KB no host (antes %llu KB)\n",
+           (unsigned long long)(bytes / 1024), (unsigned long long)(depois / 1024),
+           (unsigned long long)(antes / 1024));
+    return 0;
+}
+
+// Onde ficam os bytes finais de um arquivo empacotado
+static void exibir_armazenamento(const DirEntry *entry) {
+    if (entry->attributes & ATRIB_EMBUTIDO) {
+        printf("  Dados: embutidos na entrada\n");
+    } else if (entry->attributes & ATRIB_COMPRIMIDO) {
+        printf("  Dados: comprimidos em blocos de %d KB\n", BLOCO_COMPRESSAO >> 10);
+    } else if (entry->attributes & ATRIB_CAUDA) {
+        printf("  Cauda: %u bytes no setor de fragmentos %u (posição %u)\n",
+               entry->tail_length, entry->tail_sector, entry->tail_offset);
+    }
+}
+
+// Uso do espaço (df), respondido pelo resumo do boot record sem varrer o
+// bitmap nem construir o índice de faixas livres
+int exibir_espaco(Volume *vol) {
+    if (!volume_montado(vol)) {
+        return -1;
+    }
+    BootRecord *br = vol->br;
+    uint64_t bps = vol->bytes_per_sector;
+    uint64_t total = br->data_sectors;
+    uint64_t livres = br->free_sectors;
+    uint32_t arquivos = vol->dir_entries - vol->nomes.free_count;
+    printf("%-10s %12s %12s %12s %5s %12s\n", "Área", "Total KB", "Usado KB", "Livre KB", "Uso%", "Maior KB");
+    printf("%-9s %12llu %12llu %12llu %4.0f%% %12llu\n", "dados",
+           (unsigned long long)(total * bps / 1024), (unsigned long long)((total - livres) * bps / 1024),
+           (unsigned long long)(livres * bps / 1024), total ? 100.0 * (total - livres) / total : 0.0,
+           (unsigned long long)((uint64_t)br->largest_free_run * bps / 1024));
+    printf("Arquivos: %u de %u entradas; próxima alocação a partir do setor %u\n",
+           arquivos, vol->dir_entries, br->alloc_hint);
+
+    // Ocupação média dos setores de fragmentos
+    FragIndex *f = &vol->fragmentos;
+    uint64_t unidades = 0;
+    for (uint32_t i = 0; f->tabela && i <= f->mask; i++) {
+        if (f->tabela[i].setor != 0) unidades += (uint64_t)__builtin_popcountll(f->tabela[i].mapa);
+    }
+    if (f->quantidade > 0) {
+        printf("Setores de fragmentos: %u (%.0f%% ocupados)\n", f->quantidade,
+               100.0 * unidades / ((uint64_t)f->quantidade * FRAG_UNIDADES));
+    }
+    return 0;
+}
+
+// Contadores do cache de blocos, para dimensioná-lo pelo conjunto de trabalho
+void exibir_cache(Volume *vol) {
+    CacheBlocos *c = &vol->cache;
+    printf("\n[Cache de Blocos]\n");
+    if (c->quantidade == 0) {
+        printf("Desativado\n");
+        return;
+    }
+    uint64_t acessos = c->acertos + c->faltas;
+    printf("Blocos: %u de %zu bytes (%zu KB)\n", c->quantidade, c->tam_bloco, c->quantidade * c->tam_bloco / 1024);
+    printf("Acertos: %llu, faltas: %llu (%.1f%% de acerto)\n", (unsigned long long)c->acertos,
+           (unsigned long long)c->faltas, acessos ? 100.0 * c->acertos / acessos : 0.0);
+    printf("Lidos antecipadamente: %llu, gravados de volta: %llu\n",
+           (unsigned long long)c->antecipados, (unsigned long long)c->gravados);
+}
+
+// Limite superior, em µs, da faixa do histograma que contém o percentil p
+static uint64_t estat_percentil(const EstatOperacao *s, double p) {
+    uint64_t total = 0, acumulado = 0;
+    for (int i = 0; i < HIST_FAIXAS; i++) total += s->histograma[i];
+    if (total == 0) {
+        return 0;
+    }
+    uint64_t alvo = (uint64_t)(p * total + 0.999999);
+    for (int i = 0; i < HIST_FAIXAS; i++) {
+        acumulado += s->histograma[i];
+        if (acumulado >= alvo) return 2ULL << i;
+    }
+    return 2ULL << (HIST_FAIXAS - 1);
+}
+
+static double pct(uint64_t parte, uint64_t total) {
+    return total ? 100.0 * parte / total : 0.0;
+}
+
+static void estat_texto(const Volume *vol) {
+    printf("\n[Estatísticas por Operação]\n");
+    int alguma = 0;
+    for (int t = 0; t < OP_TIPOS; t++) {
+        const EstatOperacao *s = &vol->estat[t];
+        uint64_t n = s->ops + s->falhas;
+        if (n == 0) {
+            continue;
+        }
+        alguma = 1;
+        printf("%s: %llu ops (%llu falhas), p50 <= %llu µs, p99 <= %llu µs, média %.1f µs\n",
+               nomes_operacoes[t], (unsigned long long)s->ops, (unsigned long long)s->falhas,
+               (unsigned long long)estat_percentil(s, 0.50), (unsigned long long)estat_percentil(s, 0.99),
+               s->ns_total / 1e3 / n);
+        printf("  tempo: alocação %.1f%%, dados %.1f%%, metadados %.1f%%\n",
+               pct(s->ns_alocacao, s->ns_total), pct(s->ns_dados, s->ns_total), pct(s->ns_metadados, s->ns_total));
+        printf("  imagem: %llu KB lidos, %llu KB escritos; %llu chamadas de E/S, %llu reposicionamentos, %llu fdatasync\n",
+               (unsigned long long)(s->bytes_lidos / 1024), (unsigned long long)(s->bytes_escritos / 1024),
+               (unsigned long long)s->chamadas, (unsigned long long)s->reposicionamentos, (unsigned long long)s->syncs);
+        printf("  setores: %llu alocados, %llu liberados; sondagens do diretório: %llu; passos do alocador: %llu\n",
+               (unsigned long long)s->setores_alocados, (unsigned long long)s->setores_liberados,
+               (unsigned long long)s->sondagens_dir, (unsigned long long)s->passos_alocador);
+    }
+    if (!alguma) {
+        printf("Nenhuma operação desde a montagem\n");
+    }
+}
+
+static void estat_json(const Volume *vol) {
+    printf("{\"operacoes\": {");
+    for (int t = 0; t < OP_TIPOS; t++) {
+        const EstatOperacao *s = &vol->estat[t];
+        printf("%s\n  \"%s\": {\"ops\": %llu, \"falhas\": %llu, \"bytes_lidos\": %llu, \"bytes_escritos\": %llu, "
+               "\"chamadas\": %llu, \"reposicionamentos\": %llu, \"syncs\": %llu, \"setores_alocados\": %llu, "
+               "\"setores_liberados\": %llu, \"sondagens_dir\": %llu, \"passos_alocador\": %llu, "
+               "\"ns\": {\"total\": %llu, \"alocacao\": %llu, \"dados\": %llu, \"metadados\": %llu}, \"histograma_us\": {",
+               t ? "," : "", nomes_operacoes[t], (unsigned long long)s->ops, (unsigned long long)s->falhas,
+               (unsigned long long)s->bytes_lidos, (unsigned long long)s->bytes_escritos,
+               (unsigned long long)s->chamadas, (unsigned long long)s->reposicionamentos, (unsigned long long)s->syncs,
+               (unsigned long long)s->setores_alocados, (unsigned long long)s->setores_liberados,
+               (unsigned long long)s->sondagens_dir, (unsigned long long)s->passos_alocador,
+               (unsigned long long)s->ns_total, (unsigned long long)s->ns_alocacao,
+               (unsigned long long)s->ns_dados, (unsigned long long)s->ns_metadados);
+        // Apenas as faixas não vazias, pelo limite superior em µs
+        int primeira = 1;
+        for (int i = 0; i < HIST_FAIXAS; i++) {
+            if (s->histograma[i] == 0) continue;
+            printf("%s\"%llu\": %llu", primeira ? "" : ", ", 2ULL << i, (unsigned long long)s->histograma[i]);
+            primeira = 0;
+        }
+        printf("}}");
+    }
+    printf("\n}}\n");
+}
+
+// Um contador Prometheus com um valor por tipo de operação
+static void prom_contador(const Volume *vol, const char *nome, const char *ajuda, size_t campo, double escala) {
+    printf("# HELP sa_%s %s\n# TYPE sa_%s counter\n", nome, ajuda, nome);
+    for (int t = 0; t < OP_TIPOS; t++) {
+        uint64_t v = *(const uint64_t *)((const unsigned char *)&vol->estat[t] + campo);
+        printf("sa_%s{operacao=\"%s\"} %.9g\n", nome, nomes_operacoes[t], v * escala);
+    }
+}
+
+static void estat_prometheus(const Volume *vol) {
+    prom_contador(vol, "operacoes_total", "Operações concluídas", offsetof(EstatOperacao, ops), 1);
+    prom_contador(vol, "falhas_total", "Operações que falharam", offsetof(EstatOperacao, falhas), 1);
+    prom_contador(vol, "bytes_lidos_total", "Bytes lidos da imagem", offsetof(EstatOperacao, bytes_lidos), 1);
+    prom_contador(vol, "bytes_escritos_total", "Bytes escritos na imagem", offsetof(EstatOperacao, bytes_escritos), 1);
+    prom_contador(vol, "chamadas_total", "Chamadas de sistema de E/S", offsetof(EstatOperacao, chamadas), 1);
+    prom_contador(vol, "reposicionamentos_total", "Acessos à imagem fora de sequência", offsetof(EstatOperacao, reposicionamentos), 1);
+    prom_contador(vol, "syncs_total", "Chamadas a fdatasync", offsetof(EstatOperacao, syncs), 1);
+    prom_contador(vol, "setores_alocados_total", "Setores alocados", offsetof(EstatOperacao, setores_alocados), 1);
+    prom_contador(vol, "setores_liberados_total", "Setores liberados", offsetof(EstatOperacao, setores_liberados), 1);
+    prom_contador(vol, "sondagens_diretorio_total", "Posições da tabela de nomes visitadas", offsetof(EstatOperacao, sondagens_dir), 1);
+    prom_contador(vol, "passos_alocador_total", "Nós do índice de faixas livres visitados", offsetof(EstatOperacao, passos_alocador), 1);
+    prom_contador(vol, "alocacao_segundos_total", "Tempo reservando setores", offsetof(EstatOperacao, ns_alocacao), 1e-9);
+    prom_contador(vol, "dados_segundos_total", "Tempo transferindo dados", offsetof(EstatOperacao, ns_dados), 1e-9);
+    prom_contador(vol, "metadados_segundos_total", "Tempo gravando metadados", offsetof(EstatOperacao, ns_metadados), 1e-9);
+
+    printf("# HELP sa_latencia_segundos Latência das operações\n# TYPE sa_latencia_segundos histogram\n");
+    for (int t = 0; t < OP_TIPOS; t++) {
+        const EstatOperacao *s = &vol->estat[t];
+        uint64_t acumulado = 0;
+        for (int i = 0; i < HIST_FAIXAS; i++) {
+            acumulado += s->histograma[i];
+            printf("sa_latencia_segundos_bucket{operacao=\"%s\",le=\"%.9g\"} %llu\n",
+                   nomes_operacoes[t], (2ULL << i) * 1e-6, (unsigned long long)acumulado);
+        }
+        printf("sa_latencia_segundos_bucket{operacao=\"%s\",le=\"+Inf\"} %llu\n", nomes_operacoes[t], (unsigned long long)acumulado);
+        printf("sa_latencia_segundos_sum{operacao=\"%s\"} %.9g\n", nomes_operacoes[t], s->ns_total * 1e-9);
+        printf("sa_latencia_segundos_count{operacao=\"%s\"} %llu\n", nomes_operacoes[t], (unsigned long long)acumulado);
+    }
+}
+
+// Exibe os contadores por operação desde a montagem (ESTAT_TEXTO, ESTAT_JSON ou ESTAT_PROM)
+int exibir_estatisticas(Volume *vol, int formato) {
+    if (!volume_montado(vol)) {
+        return -1;
+    }
+    switch (formato) {
+        case ESTAT_JSON: estat_json(vol); break;
+        case ESTAT_PROM: estat_prometheus(vol); break;
+        default: estat_texto(vol);
+    }
+    fflush(stdout);
+    return 0;
+}
+
+// "texto", "json" ou "prom"; -1 se desconhecido
+int formato_estatisticas(const char *nome) {
+    if (!nome || strcmp(nome, "texto") == 0) return ESTAT_TEXTO;
+    if (strcmp(nome, "json") == 0) return ESTAT_JSON;
+    if (strcmp(nome, "prom") == 0) return ESTAT_PROM;
+    return -1;
+}
+
+// Histograma das faixas livres por tamanho: faixa i conta as de 2^i a
+// 2^(i+1) - 1 setores
+static void histograma_livres(const FreeExtent *t, uint32_t *histograma) {
+    if (!t) return;
+    histograma_livres(t->left, histograma);
+    histograma[31 - __builtin_clz(t->count)]++;
+    histograma_livres(t->right, histograma);
+}
+
+static int comparar_extents_desc(const void *a, const void *b) {
+    const DirEntry *x = *(const DirEntry *const *)a;
+    const DirEntry *y = *(const DirEntry *const *)b;
+    return (y->extent_count > x->extent_count) - (y->extent_count < x->extent_count);
+}
+
+// Relatório de fragmentação: faixas livres e extents por arquivo
+#define FRAGMENTADOS_EXIBIDOS 10
+
+static void exibir_fragmentacao(Volume *vol) {
+    FreeIndex *idx = indice_livre(vol);
+    if (!idx) {
+        return;
+    }
+    printf("\n[Fragmentação]\n");
+    printf("Faixas livres: %u (maior com %u setores, média de %.1f setores)\n", idx->extents,
+           vol->br->largest_free_run, idx->extents ? (double)vol->br->free_sectors / idx->extents : 0.0);
+    uint32_t histograma[32] = {0};
+    histograma_livres(idx->by_start, histograma);
+    for (int i = 0; i < 32; i++) {
+        if (histograma[i] == 0) continue;
+        uint64_t de = 1ULL << i, ate = (2ULL << i) - 1;
+        if (de == ate) {
+            printf("  %10llu setor(es): %u faixa(s)\n", (unsigned long long)de, histograma[i]);
+        } else {
+            printf("  %4llu a %5llu setores: %u faixa(s)\n", (unsigned long long)de,
+                   (unsigned long long)ate, histograma[i]);
+        }
+    }
+
+    // Extents por arquivo; os mais fragmentados são listados
+    DirEntry **fragmentados = (DirEntry **)malloc((vol->dir_entries ? vol->dir_entries : 1) * sizeof(DirEntry *));
+    uint32_t arquivos = 0, quantidade = 0;
+    uint64_t extents = 0;
+    for (int i = 0; i < vol->dir_entries; i++) {
+        DirEntry *entry = &vol->dir[i];
+        if (entry->status != 0x00) continue;
+        arquivos++;
+        extents += entry->extent_count;
+        if (entry->extent_count > 1 && fragmentados) fragmentados[quantidade++] = entry;
+    }
+    printf("Arquivos: %u, fragmentados: %u, extents por arquivo: %.2f\n", arquivos, quantidade,
+           arquivos ? (double)extents / arquivos : 0.0);
+    if (fragmentados) {
+        qsort(fragmentados, quantidade, sizeof(DirEntry *), comparar_extents_desc);
+        for (uint32_t k = 0; k < quantidade && k < FRAGMENTADOS_EXIBIDOS; k++) {
+            printf("  %s.%s: %u extents, %u bytes\n", fragmentados[k]->filename, fragmentados[k]->extension,
+                   fragmentados[k]->extent_count, fragmentados[k]->file_size);
+        }
+        if (quantidade > FRAGMENTADOS_EXIBIDOS) {
+            printf("  ... e mais %u\n", quantidade - FRAGMENTADOS_EXIBIDOS);
+        }
+        free(fragmentados);
+    }
+}
+
+void exibir_disco(Volume *vol) {
+    if (!volume_montado(vol)) {
+        return;
+    }
+
+    printf("\n--- Exibindo Conteúdo do Disco ---\n");
+
+    // Exibe o Boot Record
+    BootRecord *br = vol->br;
+    FreeIndex *livres = indice_livre(vol);
+    printf("\n[Boot Record]\n");
+    printf("Bytes por setor: %u\n", br->bytes_por_sector);
+    printf("Setores por bloco: %u\n", br->sectors_per_block);
+    printf("Setores reservados: %u\n", br->reserved_sectors);
+    printf("Setores do diretório: %u\n", br->dir_sectors);
+    printf("Setores do bitmap: %u\n", br->bitmap_sectors);
+    printf("Setores de dados: %u\n", br->data_sectors);
+    printf("Setores totais: %u\n", br->total_sectors);
+    printf("Contagem de arquivos: %u\n", br->file_count);
+    printf("Primeiro setor da área de dados: %u\n", br->first_free_sector);
+    printf("Capacidade do diretório: %u entradas\n", br->dir_entries);
+    printf("Setores do journal: %u (%u setores por transação)\n", br->journal_sectors, vol->journal_cap);
+    printf("Setores livres: %u (%u faixas, maior com %u setores)\n",
+           br->free_sectors, livres ? livres->extents : 0, br->largest_free_run);
+    printf("Próxima alocação next-fit a partir do setor: %u\n", br->alloc_hint);
+
+    // Exibe as entradas do diretório
+    printf("\n[Entradas do Diretório]\n");
+    for (int i = 0; i < vol->dir_entries; i++) {
+        DirEntry *entry = &vol->dir[i];
+        if (entry->status == 0x00) { // Arquivo válido
+            printf("Arquivo %d:\n", i + 1);
+            printf("  Nome: %s.%s\n", entry->filename, entry->extension);
+            printf("  Atributos: %d\n", entry->attributes);
+            printf("  Setor inicial: %u\n", entry->first_sector);
+            printf("  Extents: %u\n", entry->extent_count);
+            printf("  Tamanho: %u bytes\n", entry->file_size);
+            exibir_armazenamento(entry);
+        }
+    }
+
+    exibir_fragmentacao(vol);
+    exibir_cache(vol);
+
+    printf("\n--- Fim do Conteúdo do Disco ---\n");
+}
+
+// ---------------------------------------------------------------------------
+// Caminho de dados
+//
+// Os dados dos arquivos são transferidos em blocos de vol->transfer_size
+// bytes com pread/pwrite posicionais, um extent por vez. Apenas o último
+// setor parcial do arquivo é completado com zeros.
+// ---------------------------------------------------------------------------
+
+// Buffer de transferência alinhado ao bloco do volume
+static unsigned char *alocar_buffer_transferencia(const Volume *vol) {
+    void *buffer = NULL;
+    if (posix_memalign(&buffer, 4096, vol->transfer_size) != 0) {
+        perror("Erro ao alocar buffer de transferência");
+        return NULL;
+    }
+    return (unsigned char *)buffer;
+}
+
+// Backend mmap: lê do arquivo fonte direto para a região mapeada dos extents
+static int gravar_dados_mmap(Volume *vol, int src, const FileExtent *extents, uint32_t extent_count, uint64_t size) {
+    size_t bps = vol->bytes_per_sector;
+    uint64_t bytes_remaining = size;
+    for (uint32_t e = 0; e < extent_count && bytes_remaining > 0; e++) {
+        unsigned char *dest = vol->map + offset_setor(vol->br, extents[e].start);
+        uint64_t extent_bytes = (uint64_t)extents[e].count * bps;
+        size_t bytes_to_read = extent_bytes < bytes_remaining ? (size_t)extent_bytes : (size_t)bytes_remaining;
+        ssize_t lidos = ler_sequencial(src, dest, bytes_to_read);
+        if (lidos != (ssize_t)bytes_to_read) {
+            if (lidos >= 0) errno = EIO;
+            perror("Erro ao ler arquivo fonte");
+            return -1;
+        }
+
+        // Só o último setor parcial é completado com zeros
+        size_t padded = (bytes_to_read + bps - 1) / bps * bps;
+        memset(dest + bytes_to_read, 0, padded - bytes_to_read);
+        ESTAT(bytes_escritos, padded);
+        bytes_remaining -= bytes_to_read;
+    }
+    return 0;
+}
+
+// Backend mmap: escreve a saída direto da região mapeada de cada extent
+static int ler_dados_mmap(Volume *vol, int out, const FileExtent *extents, uint32_t extent_count, uint64_t size) {
+    size_t bps = vol->bytes_per_sector;
+    uint64_t file_size_remaining = size;
+    for (uint32_t e = 0; e < extent_count && file_size_remaining > 0; e++) {
+        const unsigned char *orig = vol->map + offset_setor(vol->br, extents[e].start);
+        uint64_t extent_bytes = (uint64_t)extents[e].count * bps;
+        size_t bytes = extent_bytes < file_size_remaining ? (size_t)extent_bytes : (size_t)file_size_remaining;
+        if (escrever_sequencial(out, orig, bytes) != 0) {
+            perror("Erro ao escrever arquivo de saída");
+            return -1;
+        }
+        ESTAT(bytes_lidos, bytes);
+        file_size_remaining -= bytes;
+    }
+    return 0;
+}
+
+// Mecanismos de cópia no kernel indisponíveis (bits de Volume.zc_indisponivel)
+#define ZC_COPY_FILE_RANGE 0x01
+#define ZC_SENDFILE        0x02
+
+// Copia len bytes de 'in' para 'out' sem passar por buffers do processo,
+// tentando copy_file_range, depois sendfile e, com origem em pipe, splice.
+// Offsets NULL usam (e avançam) a posição corrente do descritor.
+// Retorna os bytes copiados; 0 com errno = EOPNOTSUPP se nenhum mecanismo
+// atende esse par de descritores.
+static ssize_t copiar_no_kernel(Volume *vol, int in, off_t *in_off, int out, off_t *out_off, size_t len) {
+    ssize_t n;
+    ESTAT(chamadas, 1);
+
+    int indisponivel = __atomic_load_n(&vol->zc_indisponivel, __ATOMIC_RELAXED);
+    if (!(indisponivel & ZC_COPY_FILE_RANGE)) {
+        do {
+            n = copy_file_range(in, in_off, out, out_off, len, 0);
+        } while (n < 0 && errno == EINTR);
+        if (n >= 0) return n;
+        if (errno != ENOSYS && errno != EXDEV && errno != EINVAL && errno != EOPNOTSUPP && errno != EBADF) {
+            return -1;
+        }
+        __atomic_fetch_or(&vol->zc_indisponivel, ZC_COPY_FILE_RANGE, __ATOMIC_RELAXED);
+    }
+
+    struct stat st;
+    int in_pipe = fstat(in, &st) == 0 && S_ISFIFO(st.st_mode);
+    if (in_pipe) {
+        // splice exige que uma das pontas seja pipe
+        do {
+            n = splice(in, NULL, out, out_off, len, SPLICE_F_MOVE);
+        } while (n < 0 && errno == EINTR);
+        if (n >= 0 || (errno != EINVAL && errno != ENOSYS)) return n;
+    } else if (!(indisponivel & ZC_SENDFILE)) {
+        // sendfile escreve na posição corrente de 'out', compartilhada entre threads
+        if (out_off) {
+            pthread_mutex_lock(&vol->trava_posicao);
+            if (lseek(out, *out_off, SEEK_SET) < 0) {
+                pthread_mutex_unlock(&vol->trava_posicao);
+                return -1;
+            }
+        }
+        do {
+            n = sendfile(out, in, in_off, len);
+        } while (n < 0 && errno == EINTR);
+        if (out_off) {
+            pthread_mutex_unlock(&vol->trava_posicao);
+        }
+        if (n >= 0) {
+            if (out_off) *out_off += n;
+            return n;
+        }
+        if (errno != EINVAL && errno != ENOSYS) return -1;
+        __atomic_fetch_or(&vol->zc_indisponivel, ZC_SENDFILE, __ATOMIC_RELAXED);
+    }
+
+    errno = EOPNOTSUPP;
+    return 0;
+}
+
+// Motor zero-copy: arquivo fonte -> extents. Retorna 1 se nenhum mecanismo
+// de cópia no kernel está disponível e nada foi copiado (usar o buffer).
+static int gravar_dados_zero_copy(Volume *vol, int src, const FileExtent *extents, uint32_t extent_count, uint64_t size) {
+    size_t bps = vol->bytes_per_sector;
+    uint64_t bytes_remaining = size;
+    int copiou = 0;
+    for (uint32_t e = 0; e < extent_count && bytes_remaining > 0; e++) {
+        off_t offset = offset_setor(vol->br, extents[e].start);
+        uint64_t extent_bytes = (uint64_t)extents[e].count * bps;
+        uint64_t bytes = extent_bytes < bytes_remaining ? extent_bytes : bytes_remaining;
+        uint64_t falta = bytes;
+        while (falta > 0) {
+            ssize_t n = copiar_no_kernel(vol, src, NULL, vol->fd, &offset, (size_t)falta);
+            if (n == 0 && errno == EOPNOTSUPP && !copiou) {
+                return 1;
+            }
+            if (n <= 0) {
+                if (n == 0) errno = EIO;
+                perror("Erro na cópia zero-copy para o disco");
+                return -1;
+            }
+            copiou = 1;
+            falta -= n;
+            ESTAT(bytes_escritos, n);
+        }
+
+        // Só o último setor parcial é completado com zeros
+        size_t pad = (size_t)((bps - bytes % bps) % bps);
+        if (pad > 0) {
+            static const unsigned char zeros[65536];
+            if (escrever_em(vol->fd, zeros, pad, offset) != 0) {
+                perror("Erro ao gravar dados no disco");
+                return -1;
+            }
+        }
+        bytes_remaining -= bytes;
+    }
+    return 0;
+}
+
+// Motor zero-copy: extents -> arquivo de saída (mesma convenção de retorno)
+static int ler_dados_zero_copy(Volume *vol, int out, const FileExtent *extents, uint32_t extent_count, uint64_t size) {
+    size_t bps = vol->bytes_per_sector;
+    uint64_t file_size_remaining = size;
+    int copiou = 0;
+    for (uint32_t e = 0; e < extent_count && file_size_remaining > 0; e++) {
+        off_t offset = offset_setor(vol->br, extents[e].start);
+        uint64_t extent_bytes = (uint64_t)extents[e].count * bps;
+        uint64_t falta = extent_bytes < file_size_remaining ? extent_bytes : file_size_remaining;
+        file_size_remaining -= falta;
+        while (falta > 0) {
+            ssize_t n = copiar_no_kernel(vol, vol->fd, &offset, out, NULL, (size_t)falta);
+            if (n == 0 && errno == EOPNOTSUPP && !copiou) {
+                return 1;
+            }
+            if (n <= 0) {
+                if (n == 0) errno = EIO;
+                perror("Erro na cópia zero-copy do disco");
+                return -1;
+            }
+            copiou = 1;
+            falta -= n;
+            ESTAT(bytes_lidos, n);
+        }
+    }
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Motor io_uring
+//
+// Cada transferência é dividida em trechos de até vol->transfer_size bytes.
+// Até vol->queue_depth trechos ficam em andamento ao mesmo tempo, cada um
+// com seu buffer registrado no kernel: enquanto um trecho é gravado, os
+// seguintes já estão sendo lidos. O anel é usado por meio das chamadas de
+// sistema, sem liburing; se o kernel recusar io_uring a transferência segue
+// pelo buffer.
+// ---------------------------------------------------------------------------
+
+typedef struct {
+    int fd;
+    unsigned entries;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_ptr, *cq_ptr;
+    size_t sq_len, cq_len, sqes_len;
+    unsigned a_enviar;         // SQEs preenchidas e ainda não entregues ao kernel
+} AnelIO;
+
+static void anel_destruir(AnelIO *a) {
+    if (a->sqes) munmap(a->sqes, a->sqes_len);
+    if (a->cq_ptr && a->cq_ptr != a->sq_ptr) munmap(a->cq_ptr, a->cq_len);
+    if (a->sq_ptr) munmap(a->sq_ptr, a->sq_len);
+    if (a->fd >= 0) close(a->fd);
+    memset(a, 0, sizeof(AnelIO));
+    a->fd = -1;
+}
+
+static int anel_criar(AnelIO *a, unsigned entries) {
+    memset(a, 0, sizeof(AnelIO));
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    a->fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+    if (a->fd < 0) {
+        return -1;
+    }
+    a->entries = p.sq_entries;
+
+    a->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    a->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (a->cq_len > a->sq_len) a->sq_len = a->cq_len;
+        a->cq_len = a->sq_len;
+    }
+    a->sq_ptr = mmap(NULL, a->sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, a->fd, IORING_OFF_SQ_RING);
+    if (a->sq_ptr == MAP_FAILED) {
+        a->sq_ptr = NULL;
+        anel_destruir(a);
+        return -1;
+    }
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        a->cq_ptr = a->sq_ptr;
+    } else {
+        a->cq_ptr = mmap(NULL, a->cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, a->fd, IORING_OFF_CQ_RING);
+        if (a->cq_ptr == MAP_FAILED) {
+            a->cq_ptr = NULL;
+            anel_destruir(a);
+            return -1;
+        }
+    }
+    a->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    a->sqes = (struct io_uring_sqe *)mmap(NULL, a->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                          a->fd, IORING_OFF_SQES);
+    if (a->sqes == MAP_FAILED) {
+        a->sqes = NULL;
+        anel_destruir(a);
+        return -1;
+    }
+
+    unsigned char *sq = (unsigned char *)a->sq_ptr;
+    unsigned char *cq = (unsigned char *)a->cq_ptr;
+    a->sq_head = (unsigned *)(sq + p.sq_off.head);
+    a->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    a->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+    a->sq_array = (unsigned *)(sq + p.sq_off.array);
+    a->cq_head = (unsigned *)(cq + p.cq_off.head);
+    a->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    a->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+    a->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    return 0;
+}
+
+// Enfileira uma leitura ou escrita; buf_index < 0 usa o vetor iov (buffer não registrado)
+static void anel_preparar(AnelIO *a, int escrita, int fd, void *buf, size_t len, off_t off,
+                          int buf_index, struct iovec *iov, uint64_t user_data) {
+    unsigned tail = *a->sq_tail;
+    unsigned idx = tail & *a->sq_mask;
+    struct io_uring_sqe *sqe = &a->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->fd = fd;
+    sqe->off = (uint64_t)off;
+    sqe->user_data = user_data;
+    if (buf_index >= 0) {
+        sqe->opcode = escrita ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+        sqe->addr = (uint64_t)(uintptr_t)buf;
+        sqe->len = (unsigned)len;
+        sqe->buf_index = (uint16_t)buf_index;
+    } else {
+        iov->iov_base = buf;
+        iov->iov_len = len;
+        sqe->opcode = escrita ? IORING_OP_WRITEV : IORING_OP_READV;
+        sqe->addr = (uint64_t)(uintptr_t)iov;
+        sqe->len = 1;
+    }
+    a->sq_array[idx] = idx;
+    __atomic_store_n(a->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    a->a_enviar++;
+}
+
+// Entrega as SQEs pendentes e espera ao menos 'minimo' conclusões
+static int anel_enviar(AnelIO *a, unsigned minimo) {
+    for (;;) {
+        int r = (int)syscall(__NR_io_uring_enter, a->fd, a->a_enviar, minimo,
+                             minimo ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+        ESTAT(chamadas, 1);
+        if (r >= 0) {
+            a->a_enviar -= (unsigned)r < a->a_enviar ? (unsigned)r : a->a_enviar;
+            return 0;
+        }
+        if (errno != EINTR) {
+            return -1;
+        }
+    }
+}
+
+// Retira uma conclusão do anel; 0 se não houver nenhuma disponível
+static int anel_colher(AnelIO *a, uint64_t *user_data, int *res) {
+    unsigned head = *a->cq_head;
+    if (head == __atomic_load_n(a->cq_tail, __ATOMIC_ACQUIRE)) {
+        return 0;
+    }
+    struct io_uring_cqe *cqe = &a->cqes[head & *a->cq_mask];
+    *user_data = cqe->user_data;
+    *res = cqe->res;
+    __atomic_store_n(a->cq_head, head + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+// Trecho de uma transferência: len_in bytes lidos de 'in' em off_in e
+// len_out bytes (len_in completado com zeros) gravados em 'out' em off_out
+typedef struct {
+    off_t off_in, off_out;
+    size_t len_in, len_out;
+    size_t feito;              // bytes já concluídos da etapa atual
+    int gravando;              // 0 = lendo, 1 = gravando
+    int ativo;
+} TrechoIO;
+
+// Gerador dos trechos, extent por extent, em passos de transfer_size
+typedef struct {
+    const FileExtent *extents;
+    uint32_t extent_count;
+    uint32_t e;                // extent atual
+    uint64_t extent_rem;       // bytes restantes do extent atual
+    off_t off_disco;           // próxima posição na imagem
+    off_t off_arquivo;         // próxima posição no arquivo externo
+    uint64_t restante;         // bytes do arquivo ainda não distribuídos
+} GeradorTrechos;
+
+static int proximo_trecho(Volume *vol, GeradorTrechos *g, int importando, TrechoIO *t) {
+    size_t bps = vol->bytes_per_sector;
+    while (g->restante > 0 && g->extent_rem == 0) {
+        if (g->e >= g->extent_count) return 0;
+        g->off_disco = offset_setor(vol->br, g->extents[g->e].start);
+        g->extent_rem = (uint64_t)g->extents[g->e].count * bps;
+        g->e++;
+    }
+    if (g->restante == 0) {
+        return 0;
+    }
+    size_t span = g->extent_rem < vol->transfer_size ? (size_t)g->extent_rem : vol->transfer_size;
+    size_t bytes = g->restante < span ? (size_t)g->restante : span;
+    size_t bytes_disco = importando ? (bytes + bps - 1) / bps * bps : bytes;
+
+    memset(t, 0, sizeof(TrechoIO));
+    t->ativo = 1;
+    t->len_in = bytes;
+    t->len_out = bytes_disco;
+    t->off_in = importando ? g->off_arquivo : g->off_disco;
+    t->off_out = importando ? g->off_disco : g->off_arquivo;
+    if (!importando) t->len_out = bytes;
+
+    g->off_disco += bytes_disco;
+    g->off_arquivo += bytes;
+    g->extent_rem -= bytes_disco < g->extent_rem ? bytes_disco : g->extent_rem;
+    g->restante -= bytes;
+    return 1;
+}
+
+// Transfere entre 'in' e 'out' pelos extents com operações em fila.
+// Retorna 0, -1 em erro ou 1 se o io_uring não estiver disponível.
+static int transferir_io_uring(Volume *vol, int in, int out, int importando, off_t inicio_arquivo,
+                               const FileExtent *extents, uint32_t extent_count, uint64_t size) {
+    if (__atomic_load_n(&vol->uring_indisponivel, __ATOMIC_RELAXED)) {
+        return 1;
+    }
+
+    // Conta os trechos como o gerador os produz (cada extent em passos de
+    // transfer_size, até o fim do arquivo), parando na profundidade da fila:
+    // com um único trecho não há o que sobrepor
+    uint32_t profundidade = (uint32_t)vol->queue_depth;
+    uint64_t trechos = 0;
+    uint64_t restante = size;
+    for (uint32_t k = 0; k < extent_count && restante > 0 && trechos < profundidade; k++) {
+        uint64_t bytes = (uint64_t)extents[k].count * vol->bytes_per_sector;
+        if (bytes > restante) bytes = restante;
+        trechos += (bytes + vol->transfer_size - 1) / vol->transfer_size;
+        restante -= bytes;
+    }
+    if (trechos <= 1) {
+        return 1;
+    }
+    if (profundidade > trechos) profundidade = (uint32_t)trechos;
+
+    AnelIO anel;
+    if (anel_criar(&anel, profundidade) != 0) {
+        __atomic_store_n(&vol->uring_indisponivel, 1, __ATOMIC_RELAXED);
+        return 1;
+    }
+
+    unsigned char *buffers = NULL;
+    if (posix_memalign((void **)&buffers, 4096, (size_t)profundidade * vol->transfer_size) != 0) {
+        anel_destruir(&anel);
+        return 1;
+    }
+    TrechoIO slots[QUEUE_DEPTH_MAX];
+    struct iovec iovs[QUEUE_DEPTH_MAX];
+    for (uint32_t k = 0; k < profundidade; k++) {
+        iovs[k].iov_base = buffers + (size_t)k * vol->transfer_size;
+        iovs[k].iov_len = vol->transfer_size;
+        slots[k].ativo = 0;
+    }
+
+    // Buffers registrados evitam mapear as páginas a cada operação; sem
+    // memória bloqueável suficiente, usa leituras e escritas vetoriais
+    int registrados = syscall(__NR_io_uring_register, anel.fd, IORING_REGISTER_BUFFERS, iovs, profundidade) == 0;
+    struct iovec iov_op[QUEUE_DEPTH_MAX];
+
+    GeradorTrechos g = {extents, extent_count, 0, 0, 0, inicio_arquivo, size};
+    uint32_t ativos = 0;
+    int erro = 0;
+    int fim = 0;
+    for (;;) {
+        // Preenche os slots livres com novas leituras
+        for (uint32_t k = 0; k < profundidade && !erro && !fim; k++) {
+            if (slots[k].ativo) continue;
+            if (!proximo_trecho(vol, &g, importando, &slots[k])) {
+                fim = 1;
+                break;
+            }
+            anel_preparar(&anel, 0, in, iovs[k].iov_base, slots[k].len_in, slots[k].off_in,
+                          registrados ? (int)k : -1, &iov_op[k], k);
+            ativos++;
+        }
+        if (ativos == 0) {
+            break;
+        }
+        if (anel_enviar(&anel, 1) != 0) {
+            // Sem como acompanhar as operações em andamento, os buffers não
+            // podem ser reutilizados: ficam alocados até o fim do processo
+            perror("Erro no io_uring");
+            anel_destruir(&anel);
+            return -1;
+        }
+
+        uint64_t k;
+        int res;
+        while (anel_colher(&anel, &k, &res)) {
+            TrechoIO *t = &slots[k];
+            unsigned char *buf = (unsigned char *)iovs[k].iov_base;
+            size_t alvo = t->gravando ? t->len_out : t->len_in;
+            if (res <= 0 || erro) {
+                if (!erro) {
+                    errno = res < 0 ? -res : EIO;
+                    perror(t->gravando ? "Erro ao gravar dados" : "Erro ao ler dados");
+                }
+                erro = 1;
+                t->ativo = 0;
+                ativos--;
+                continue;
+            }
+            t->feito += (size_t)res;
+            if (importando && t->gravando) {
+                ESTAT(bytes_escritos, (uint64_t)res);
+            } else if (!importando && !t->gravando) {
+                ESTAT(bytes_lidos, (uint64_t)res);
+            }
+            if (t->feito < alvo) {
+                // Operação parcial: reenvia o restante
+                anel_preparar(&anel, t->gravando, t->gravando ? out : in, buf + t->feito, alvo - t->feito,
+                              (t->gravando ? t->off_out : t->off_in) + (off_t)t->feito,
+                              registrados ? (int)k : -1, &iov_op[k], k);
+                continue;
+            }
+            if (!t->gravando) {
+                // Só o último setor parcial do arquivo é completado com zeros
+                if (t->len_out > t->len_in) memset(buf + t->len_in, 0, t->len_out - t->len_in);
+                t->gravando = 1;
+                t->feito = 0;
+                anel_preparar(&anel, 1, out, buf, t->len_out, t->off_out, registrados ? (int)k : -1, &iov_op[k], k);
+                continue;
+            }
+            t->ativo = 0;
+            ativos--;
+        }
+        if (erro) {
+            fim = 1;
+        }
+    }
+
+    anel_destruir(&anel);
+    free(buffers);
+    return erro ? -1 : 0;
+}
+
+// Transferências de até um quarto do cache passam por ele; as maiores
+// apenas expulsariam o conjunto de trabalho
+static inline int usa_cache(const Volume *vol, uint64_t size) {
+    return vol->cache.quantidade > 0 && size <= (uint64_t)vol->cache.quantidade * vol->cache.tam_bloco / 4;
+}
+
+// Aplica cache_contornar aos setores dos extents ocupados pelo arquivo
+static int contornar_cache(Volume *vol, const FileExtent *extents, uint32_t extent_count, uint64_t size, int descartar) {
+    uint64_t restante = size;
+    for (uint32_t e = 0; e < extent_count && restante > 0; e++) {
+        uint64_t bytes = (uint64_t)extents[e].count * vol->bytes_per_sector;
+        if (bytes > restante) bytes = restante;
+        if (cache_contornar(&vol->cache, vol->fd, offset_setor(vol->br, extents[e].start), bytes, descartar) != 0) {
+            return -1;
+        }
+        restante -= bytes;
+    }
+    return 0;
+}
+
+// Lê ou escreve 'len' bytes na posição lógica 'off', coberta pelos extents.
+// 'escrita' vale ESCRITA_NOVA quando nada depois de off + len guarda dados
+// (setores recém-alocados ou além do fim do arquivo). Com 'direto' o
+// backend stdio acessa a imagem sem o cache (quem chama já aplicou
+// contornar_cache aos setores).
+#define ESCRITA_NOVA 2
+
+static int acessar_extents(Volume *vol, const FileExtent *lista, uint32_t qtd, uint64_t off,
+                           unsigned char *buf, size_t len, int escrita, int direto) {
+    direto = direto && vol->backend != BACKEND_MMAP;
+    uint64_t bps = vol->bytes_per_sector;
+    uint64_t base = 0;
+    for (uint32_t e = 0; e < qtd && len > 0; e++) {
+        uint64_t tam = (uint64_t)lista[e].count * bps;
+        if (off < base + tam) {
+            uint64_t dentro = off - base;
+            size_t n = tam - dentro < len ? (size_t)(tam - dentro) : len;
+            off_t pos = offset_setor(vol->br, lista[e].start) + (off_t)dentro;
+            int r = direto ? (escrita ? escrever_em(vol->fd, buf, n, pos) : ler_em(vol->fd, buf, n, pos))
+                           : (escrita ? disco_escrever(vol, buf, n, pos, escrita == ESCRITA_NOVA) : disco_ler(vol, buf, n, pos));
+            if (r != 0) {
+                errno = EIO;
+                return -1;
+            }
+            buf += n;
+            off += n;
+            len -= n;
+        }
+        base += tam;
+    }
+    if (len > 0) {
+        errno = EIO;
+        return -1;
+    }
+    return 0;
+}
+
+// Copia 'size' bytes do descritor src (posição atual) para os extents
+static int gravar_dados(Volume *vol, int src, const FileExtent *extents, uint32_t extent_count, uint64_t size) {
+    if (vol->backend == BACKEND_MMAP) {
+        return gravar_dados_mmap(vol, src, extents, extent_count, size);
+    }
+
+    // Arquivos pequenos passam pelo cache; os demais o contornam, e blocos
+    // em cache desses setores deixariam de refletir o disco
+    int usar_cache = usa_cache(vol, size);
+    if (!usar_cache && contornar_cache(vol, extents, extent_count, size, 1) != 0) {
+        perror("Erro ao gravar o cache de blocos");
+        return -1;
+    }
+    if (!usar_cache && vol->io_engine == MOTOR_ZERO_COPY) {
+        int status = gravar_dados_zero_copy(vol, src, extents, extent_count, size);
+        if (status <= 0) return status;
+        // Sem cópia no kernel para esse par de arquivos: segue pelo buffer
+    }
+    if (!usar_cache && vol->io_engine == MOTOR_IO_URING) {
+        struct stat st;
+        off_t inicio = lseek(src, 0, SEEK_CUR);
+        if (inicio >= 0 && fstat(src, &st) == 0 && S_ISREG(st.st_mode)) {
+            int status = transferir_io_uring(vol, src, vol->fd, 1, inicio, extents, extent_count, size);
+            if (status <= 0) return status;
+        }
+    }
+
+    size_t bps = vol->bytes_per_sector;
+    unsigned char *buffer = alocar_buffer_transferencia(vol);
+    if (!buffer) {
+        return -1;
+    }
+
+    uint64_t bytes_remaining = size;
+    for (uint32_t e = 0; e < extent_count && bytes_remaining > 0; e++) {
+        off_t offset = offset_setor(vol->br, extents[e].start);
+        uint64_t extent_bytes = (uint64_t)extents[e].count * bps;
+        while (extent_bytes > 0 && bytes_remaining > 0) {
+            size_t span = extent_bytes < vol->transfer_size ? (size_t)extent_bytes : vol->transfer_size;
+            size_t bytes_to_read = (bytes_remaining > span) ? span : (size_t)bytes_remaining;
+            ssize_t lidos = ler_sequencial(src, buffer, bytes_to_read);
+            if (lidos != (ssize_t)bytes_to_read) {
+                if (lidos >= 0) errno = EIO;
+                perror("Erro ao ler arquivo fonte");
+                free(buffer);
+                return -1;
+            }
+
+            // Só o último setor parcial é completado com zeros
+            size_t bytes_to_write = (bytes_to_read + bps - 1) / bps * bps;
+            if (bytes_to_write > bytes_to_read)
+                memset(buffer + bytes_to_read, 0, bytes_to_write - bytes_to_read);
+            int escrito = usar_cache ? cache_escrever(&vol->cache, vol->fd, buffer, bytes_to_write, offset, 1)
+                                     : escrever_em(vol->fd, buffer, bytes_to_write, offset);
+            if (escrito != 0) {
+                perror("Erro ao gravar dados no disco");
+                free(buffer);
+                return -1;
+            }
+            offset += bytes_to_write;
+            bytes_remaining -= bytes_to_read;
+            extent_bytes -= bytes_to_write;
+        }
+    }
+
+    free(buffer);
+    return 0;
+}
+
+// Copia os primeiros 'size' bytes dos extents para o descritor out
+static int ler_dados(Volume *vol, int out, const FileExtent *extents, uint32_t extent_count, uint64_t size) {
+    if (vol->backend == BACKEND_MMAP) {
+        return ler_dados_mmap(vol, out, extents, extent_count, size);
+    }
+
+    // Fora do cache a leitura vai ao arquivo, que precisa ter os blocos sujos
+    int usar_cache = usa_cache(vol, size);
+    if (!usar_cache && contornar_cache(vol, extents, extent_count, size, 0) != 0) {
+        perror("Erro ao gravar o cache de blocos");
+        return -1;
+    }
+    if (!usar_cache && vol->io_engine == MOTOR_ZERO_COPY) {
+        int status = ler_dados_zero_copy(vol, out, extents, extent_count, size);
+        if (status <= 0) return status;
+    }
+    if (!usar_cache && vol->io_engine == MOTOR_IO_URING) {
+        struct stat st;
+        off_t inicio = lseek(out, 0, SEEK_CUR);
+        if (inicio >= 0 && fstat(out, &st) == 0 && S_ISREG(st.st_mode)) {
+            int status = transferir_io_uring(vol, vol->fd, out, 0, inicio, extents, extent_count, size);
+            if (status <= 0) return status;
+        }
+    }
+
+    size_t bps = vol->bytes_per_sector;
+    unsigned char *buffer = alocar_buffer_transferencia(vol);
+    if (!buffer) {
+        return -1;
+    }
+
+    uint64_t file_size_remaining = size;
+    for (uint32_t e = 0; e < extent_count && file_size_remaining > 0; e++) {
+        off_t offset = offset_setor(vol->br, extents[e].start);
+        uint64_t extent_bytes = (uint64_t)extents[e].count * bps;
+        if (extent_bytes > file_size_remaining) {
+            extent_bytes = file_size_remaining;
+        }
+
+        while (extent_bytes > 0) {
+            size_t bytes_to_read = extent_bytes < vol->transfer_size ? (size_t)extent_bytes : vol->transfer_size;
+            int lido = usar_cache ? cache_ler(&vol->cache, vol->fd, buffer, bytes_to_read, offset)
+                                  : ler_em(vol->fd, buffer, bytes_to_read, offset);
+            if (lido != 0) {
+                perror("Erro ao ler setor do arquivo");
+                free(buffer);
+                return -1;
+            }
+            if (escrever_sequencial(out, buffer, bytes_to_read) != 0) {
+                perror("Erro ao escrever arquivo de saída");
+                free(buffer);
+                return -1;
+            }
+            offset += bytes_to_read;
+            extent_bytes -= bytes_to_read;
+            file_size_remaining -= bytes_to_read;
+        }
+    }
+
+    free(buffer);
+    return 0;
+}
+
+// Início de uma medição de tempo de parede e de CPU do processo
+typedef struct {
+    struct timespec inicio;
+    struct rusage uso;
+} Medicao;
+
+static void medicao_iniciar(Medicao *m) {
+    clock_gettime(CLOCK_MONOTONIC, &m->inicio);
+    getrusage(RUSAGE_SELF, &m->uso);
+}
+
+static double tv_ms(const struct timeval *a, const struct timeval *b) {
+    return (b->tv_sec - a->tv_sec) * 1e3 + (b->tv_usec - a->tv_usec) / 1e3;
+}
+
+// Exibe vazão e custo de CPU de uma transferência (apenas com SA_REPORT=1)
+static void medicao_relatar(const Volume *vol, const Medicao *m, const char *operacao, uint64_t bytes) {
+    if (!vol->report) {
+        return;
+    }
+    struct timespec fim;
+    struct rusage uso;
+    clock_gettime(CLOCK_MONOTONIC, &fim);
+    getrusage(RUSAGE_SELF, &uso);
+
+    double ms = (fim.tv_sec - m->inicio.tv_sec) * 1e3 + (fim.tv_nsec - m->inicio.tv_nsec) / 1e6;
+    double mbs = ms > 0 ? (bytes / 1048576.0) / (ms / 1e3) : 0;
+    const char *motor = vol->backend == BACKEND_MMAP ? "mmap"
+                      : vol->io_engine == MOTOR_ZERO_COPY ? "zero-copy"
+                      : vol->io_engine == MOTOR_IO_URING ? "io_uring" : "buffer";
+    printf("[%s/%s] %llu bytes em %.3f ms (%.1f MB/s), CPU usuário %.3f ms, sistema %.3f ms\n",
+           operacao, motor, (unsigned long long)bytes, ms, mbs,
+           tv_ms(&m->uso.ru_utime, &uso.ru_utime), tv_ms(&m->uso.ru_stime, &uso.ru_stime));
+}
+
+// ---------------------------------------------------------------------------
+// Compressão
+//
+// Com SA_COMPRESS=1 os arquivos importados são divididos em blocos de
+// BLOCO_COMPRESSAO bytes comprimidos um a um, no formato de bloco do LZ4
+// (sequências de literais e cópias de até 64 KB para trás). Os extents de
+// um arquivo com ATRIB_COMPRIMIDO guardam a tabela de posições seguida dos
+// blocos:
+//
+//   uint32_t posicao[n + 1]   posição de cada bloco a partir do início dos
+//                             extents; posicao[n] é o fim do último bloco
+//   blocos                    cada um com posicao[i + 1] - posicao[i] bytes
+//
+// Um bloco que não diminui fica gravado como está (o tamanho armazenado
+// igual ao original o identifica). Como cada bloco se descomprime sozinho,
+// uma leitura posicional pequena custa a leitura da tabela, uma única vez
+// por arquivo aberto, e a de um bloco. file_size continua sendo o tamanho
+// original; os setores ocupados seguem a soma dos blocos.
+// ---------------------------------------------------------------------------
+
+// Entradas da tabela hash do compressor (posição + 1; 0 = vazia)
+#define LZ_HASH_BITS 12
+// Cópias têm pelo menos 4 bytes; as últimas 5 posições são sempre
+// literais e nenhuma cópia começa nos últimos 12 bytes do bloco
+#define LZ_COPIA_MIN 4
+#define LZ_FIM_LITERAIS 5
+#define LZ_FIM_COPIAS 12
+
+static inline uint32_t lz_ler32(const unsigned char *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t lz_hash(uint32_t v) {
+    return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+// Grava um comprimento que não coube nos 4 bits do token
+static inline unsigned char *lz_comprimento(unsigned char *op, size_t n) {
+    for (; n >= 255; n -= 255) {
+        *op++ = 255;
+    }
+    *op++ = (unsigned char)n;
+    return op;
+}
+
+// Comprime 'n' bytes (até BLOCO_COMPRESSAO) em no máximo 'cap' bytes;
+// retorna o tamanho comprimido ou 0 se não couber
+static size_t lz_comprimir(const unsigned char *src, size_t n, unsigned char *dst, size_t cap) {
+    uint32_t tabela[1 << LZ_HASH_BITS];
+    memset(tabela, 0, sizeof(tabela));
+    const unsigned char *ip = src;
+    const unsigned char *ancora = src;
+    const unsigned char *fim = src + n;
+    unsigned char *op = dst;
+    unsigned char *op_fim = dst + cap;
+
+    if (n > LZ_FIM_COPIAS) {
+        const unsigned char *limite = fim - LZ_FIM_COPIAS;
+        while (ip < limite) {
+            uint32_t seq = lz_ler32(ip);
+            uint32_t h = lz_hash(seq);
+            uint32_t candidato = tabela[h];
+            tabela[h] = (uint32_t)(ip - src) + 1;
+            const unsigned char *ref = src + candidato - 1;
+            if (candidato == 0 || ip - ref > 65535 || lz_ler32(ref) != seq) {
+                // Dados sem repetições são percorridos em passos crescentes
+                ip += 1 + ((size_t)(ip - ancora) >> 6);
+                continue;
+            }
+
+            const unsigned char *m = ip + LZ_COPIA_MIN;
+            const unsigned char *r = ref + LZ_COPIA_MIN;
+            while (m < fim - LZ_FIM_LITERAIS && *m == *r) {
+                m++;
+                r++;
+            }
+            size_t literais = (size_t)(ip - ancora);
+            size_t copia = (size_t)(m - ip) - LZ_COPIA_MIN;
+            if ((size_t)(op_fim - op) < 1 + literais / 255 + 1 + literais + 2 + copia / 255 + 1) {
+                return 0;
+            }
+
+            unsigned char *token = op++;
+            *token = (unsigned char)((literais < 15 ? literais : 15) << 4);
+            if (literais >= 15) op = lz_comprimento(op, literais - 15);
+            memcpy(op, ancora, literais);
+            op += literais;
+            uint16_t distancia = (uint16_t)(ip - ref);
+            *op++ = (unsigned char)(distancia & 0xff);
+            *op++ = (unsigned char)(distancia >> 8);
+            *token |= (unsigned char)(copia < 15 ? copia : 15);
+            if (copia >= 15) op = lz_comprimento(op, copia - 15);
+            ip = m;
+            ancora = ip;
+        }
+    }
+
+    // Literais finais
+    size_t literais = (size_t)(fim - ancora);
+    if ((size_t)(op_fim - op) < 1 + literais / 255 + 1 + literais) {
+        return 0;
+    }
+    *op++ = (unsigned char)((literais < 15 ? literais : 15) << 4);
+    if (literais >= 15) op = lz_comprimento(op, literais - 15);
+    memcpy(op, ancora, literais);
+    op += literais;
+    return (size_t)(op - dst);
+}
+
+// Descomprime 'n' bytes em até 'cap' bytes; retorna o tamanho obtido ou -1
+// se os dados estiverem corrompidos (nenhum acesso sai dos buffers)
+static ssize_t lz_descomprimir(const unsigned char *src, size_t n, unsigned char *dst, size_t cap) {
+    const unsigned char *ip = src;
+    const unsigned char *ip_fim = src + n;
+    unsigned char *op = dst;
+    unsigned char *op_fim = dst + cap;
+    while (ip < ip_fim) {
+        unsigned token = *ip++;
+        size_t literais = token >> 4;
+        if (literais == 15) {
+            unsigned char b;
+            do {
+                if (ip >= ip_fim) return -1;
+                b = *ip++;
+                literais += b;
+            } while (b == 255);
+        }
+        if (literais > (size_t)(ip_fim - ip) || literais > (size_t)(op_fim - op)) {
+            return -1;
+        }
+        memcpy(op, ip, literais);
+        ip += literais;
+        op += literais;
+        if (ip == ip_fim) {
+            break;             // a última sequência só tem literais
+        }
+
+        if (ip_fim - ip < 2) return -1;
+        size_t distancia = (size_t)ip[0] | ((size_t)ip[1] << 8);
+        ip += 2;
+        size_t copia = token & 15;
+        if (copia == 15) {
+            unsigned char b;
+            do {
+                if (ip >= ip_fim) return -1;
+                b = *ip++;
+                copia += b;
+            } while (b == 255);
+        }
+        copia += LZ_COPIA_MIN;
+        if (distancia == 0 || distancia > (size_t)(op - dst) || copia > (size_t)(op_fim - op)) {
+            return -1;
+        }
+        const unsigned char *ref = op - distancia;
+        if (distancia >= copia) {
+            memcpy(op, ref, copia);
+            op += copia;
+        } else {
+            while (copia-- > 0) *op++ = *ref++;   // cópia sobreposta (repetição)
+        }
+    }
+    return (ssize_t)(op - dst);
+}
+
+// Blocos de um arquivo comprimido de 'size' bytes
+static inline uint32_t blocos_compressao(uint64_t size) {
+    return (uint32_t)((size + BLOCO_COMPRESSAO - 1) / BLOCO_COMPRESSAO);
+}
+
+// Tamanho original do bloco i
+static inline size_t tamanho_bloco(uint64_t size, uint32_t i) {
+    uint64_t resto = size - (uint64_t)i * BLOCO_COMPRESSAO;
+    return resto < BLOCO_COMPRESSAO ? (size_t)resto : BLOCO_COMPRESSAO;
+}
+
+// Buffers dos lotes de compressão: transfer_size bytes, mas sempre ao
+// menos um bloco inteiro (um bloco que não diminui é gravado como está)
+static inline size_t buffer_compressao(const Volume *vol) {
+    return vol->transfer_size > BLOCO_COMPRESSAO ? vol->transfer_size : BLOCO_COMPRESSAO;
+}
+
+// Pior caso dos bytes armazenados: tabela e blocos gravados como estão
+static inline uint64_t maximo_comprimido(uint64_t size) {
+    return (uint64_t)(blocos_compressao(size) + 1) * sizeof(uint32_t) + size;
+}
+
+// Carrega e valida a tabela de posições dos blocos; NULL (errno = EIO) se
+// ela não corresponde aos setores do arquivo
+static uint32_t *carregar_tabela(Volume *vol, const FileExtent *lista, uint32_t qtd, uint64_t size, int direto) {
+    uint32_t n = blocos_compressao(size);
+    uint64_t disponivel = 0;
+    for (uint32_t e = 0; e < qtd; e++) {
+        disponivel += (uint64_t)lista[e].count * vol->bytes_per_sector;
+    }
+    uint32_t *tabela = (uint32_t *)malloc((n + 1) * sizeof(uint32_t));
+    if (!tabela) {
+        return NULL;
+    }
+    int valida = acessar_extents(vol, lista, qtd, 0, (unsigned char *)tabela,
+                                 (n + 1) * sizeof(uint32_t), 0, direto) == 0 &&
+                 tabela[0] == (n + 1) * sizeof(uint32_t) && tabela[n] <= disponivel;
+    for (uint32_t i = 0; i < n && valida; i++) {
+        valida = tabela[i + 1] > tabela[i] && tabela[i + 1] - tabela[i] <= tamanho_bloco(size, i);
+    }
+    if (!valida) {
+        free(tabela);
+        errno = EIO;
+        return NULL;
+    }
+    return tabela;
+}
+
+// Restaura o bloco i, armazenado em 'dados', para 'destino'
+static int expandir_bloco(const uint32_t *tabela, uint64_t size, uint32_t i,
+                          const unsigned char *dados, unsigned char *destino) {
+    size_t original = tamanho_bloco(size, i);
+    size_t armazenado = tabela[i + 1] - tabela[i];
+    if (armazenado == original) {
+        memcpy(destino, dados, original);
+    } else if (lz_descomprimir(dados, armazenado, destino, original) != (ssize_t)original) {
+        errno = EIO;
+        return -1;
+    }
+    return 0;
+}
+
+// Lê 'size' bytes de src a partir do início, comprime bloco a bloco e grava
+// tabela e blocos nos extents (reservados para maximo_comprimido). Em
+// *armazenado fica a quantidade de bytes ocupada.
+static int gravar_comprimido(Volume *vol, int src, const FileExtent *extents, uint32_t extent_count,
+                             uint64_t size, uint64_t *armazenado) {
+    uint32_t n = blocos_compressao(size);
+    int direto = !usa_cache(vol, maximo_comprimido(size));
+    if (direto && vol->backend != BACKEND_MMAP &&
+        contornar_cache(vol, extents, extent_count, maximo_comprimido(size), 1) != 0) {
+        perror("Erro ao gravar o cache de blocos");
+        return -1;
+    }
+
+    // Leituras da fonte em múltiplos do bloco; saída acumulada até encher o
+    // buffer antes de cada escrita
+    size_t capacidade = buffer_compressao(vol);
+    size_t lote = capacidade - capacidade % BLOCO_COMPRESSAO;
+    uint32_t *tabela = (uint32_t *)malloc((n + 1) * sizeof(uint32_t));
+    unsigned char *entrada = (unsigned char *)malloc(capacidade);
+    unsigned char *saida = (unsigned char *)malloc(capacidade);
+    unsigned char *comprimido = (unsigned char *)malloc(BLOCO_COMPRESSAO);
+    if (!tabela || !entrada || !saida || !comprimido) {
+        perror("Erro ao alocar memória para a compressão");
+        free(tabela);
+        free(entrada);
+        free(saida);
+        free(comprimido);
+        return -1;
+    }
+
+    uint64_t posicao = (uint64_t)(n + 1) * sizeof(uint32_t);
+    uint64_t inicio_saida = posicao;
+    size_t pendente = 0;
+    int status = 0;
+    for (uint32_t i = 0; i < n && status == 0; i += lote / BLOCO_COMPRESSAO) {
+        uint64_t off = (uint64_t)i * BLOCO_COMPRESSAO;
+        size_t bytes = size - off < lote ? (size_t)(size - off) : lote;
+        if (ler_em(src, entrada, bytes, (off_t)off) != 0) {
+            perror("Erro ao ler arquivo fonte");
+            status = -1;
+            break;
+        }
+        for (uint32_t b = i; b < n && (uint64_t)b * BLOCO_COMPRESSAO < off + bytes; b++) {
+            const unsigned char *original = entrada + ((uint64_t)b * BLOCO_COMPRESSAO - off);
+            size_t tam = tamanho_bloco(size, b);
+            size_t c = lz_comprimir(original, tam, comprimido, tam - 1);
+            if (pendente + tam > capacidade) {
+                if (acessar_extents(vol, extents, extent_count, inicio_saida, saida, pendente, ESCRITA_NOVA, direto) != 0) {
+                    perror("Erro ao gravar dados no disco");
+                    status = -1;
+                    break;
+                }
+                inicio_saida += pendente;
+                pendente = 0;
+            }
+            memcpy(saida + pendente, c > 0 ? comprimido : original, c > 0 ? c : tam);
+            pendente += c > 0 ? c : tam;
+            tabela[b] = (uint32_t)posicao;
+            posicao += c > 0 ? c : tam;
+        }
+    }
+    if (status == 0) {
+        tabela[n] = (uint32_t)posicao;
+        if (acessar_extents(vol, extents, extent_count, inicio_saida, saida, pendente, ESCRITA_NOVA, direto) != 0 ||
+            acessar_extents(vol, extents, extent_count, 0, (unsigned char *)tabela,
+                            (n + 1) * sizeof(uint32_t), 1, direto) != 0) {
+            perror("Erro ao gravar dados no disco");
+            status = -1;
+        }
+    }
+    free(tabela);
+    free(entrada);
+    free(saida);
+    free(comprimido);
+    *armazenado = posicao;
+    return status;
+}
+
+// Restaura os 'size' bytes de um arquivo comprimido no descritor out. Os
+// blocos são lidos em lotes consecutivos de até buffer_compressao bytes.
+static int ler_comprimido(Volume *vol, int out, const FileExtent *extents, uint32_t extent_count, uint64_t size) {
+    uint64_t setores = 0;
+    for (uint32_t e = 0; e < extent_count; e++) {
+        setores += extents[e].count;
+    }
+    uint64_t ocupado = setores * vol->bytes_per_sector;
+    int direto = !usa_cache(vol, ocupado);
+    if (direto && vol->backend != BACKEND_MMAP &&
+        contornar_cache(vol, extents, extent_count, ocupado, 0) != 0) {
+        perror("Erro ao gravar o cache de blocos");
+        return -1;
+    }
+    uint32_t *tabela = carregar_tabela(vol, extents, extent_count, size, direto);
+    if (!tabela) {
+        printf("Erro: Tabela de blocos comprimidos corrompida\n");
+        return -1;
+    }
+
+    uint32_t n = blocos_compressao(size);
+    size_t capacidade = buffer_compressao(vol);
+    unsigned char *entrada = (unsigned char *)malloc(capacidade);
+    unsigned char *saida = (unsigned char *)malloc(capacidade);
+    int status = entrada && saida ? 0 : -1;
+    if (status != 0) {
+        perror("Erro ao alocar memória para a compressão");
+    }
+    size_t pendente = 0;
+    for (uint32_t i = 0; i < n && status == 0;) {
+        uint32_t primeiro = i;
+        uint32_t j = i + 1;
+        while (j < n && tabela[j + 1] - tabela[i] <= capacidade) {
+            j++;
+        }
+        if (acessar_extents(vol, extents, extent_count, tabela[i], entrada, tabela[j] - tabela[i], 0, direto) != 0) {
+            perror("Erro ao ler setor do arquivo");
+            status = -1;
+            break;
+        }
+        for (; i < j; i++) {
+            if (pendente + BLOCO_COMPRESSAO > capacidade) {
+                if (escrever_sequencial(out, saida, pendente) != 0) {
+                    perror("Erro ao escrever arquivo de saída");
+                    status = -1;
+                    break;
+                }
+                pendente = 0;
+            }
+            if (expandir_bloco(tabela, size, i, entrada + (tabela[i] - tabela[primeiro]), saida + pendente) != 0) {
+                printf("Erro: Bloco comprimido %u corrompido\n", i);
+                status = -1;
+                break;
+            }
+            pendente += tamanho_bloco(size, i);
+        }
+    }
+    if (status == 0 && escrever_sequencial(out, saida, pendente) != 0) {
+        perror("Erro ao escrever arquivo de saída");
+        status = -1;
+    }
+    free(tabela);
+    free(entrada);
+    free(saida);
+    return status;
+}
+
+// Importação em andamento: arquivo fonte aberto e setores já reservados
+typedef struct {
+    const char *nome;          // nome do arquivo fonte
+    int src;                   // descritor do arquivo fonte
+    uint64_t size;             // tamanho do arquivo em bytes
+    char chave[NOME_CHAVE];    // nome e extensão como gravados no diretório
+    FileExtent *extents;       // setores reservados para os dados
+    uint32_t extent_count;
+    uint32_t cauda_setor;      // setor de fragmentos reservado para a cauda
+    uint32_t cauda_offset;     // posição da cauda no setor
+    uint32_t cauda;            // bytes da cauda (0 = sem cauda)
+    int embutido;              // dados guardados na própria entrada
+    unsigned char dados[EMBUTIDO_MAX]; // conteúdo de um arquivo embutido
+    int comprimido;            // gravado em blocos comprimidos (ATRIB_COMPRIMIDO)
+    uint64_t armazenado;       // bytes ocupados pela tabela e pelos blocos comprimidos
+    int status;                // resultado da transferência dos dados
+    uint64_t ns;               // tempo gasto até aqui (preparação e transferência)
+} Importacao;
+
+static int abrir_importacao(Volume *vol, const char *source_filename, Importacao *imp) {
+    memset(imp, 0, sizeof(Importacao));
+    imp->nome = source_filename;
+    imp->src = -1;
+    if (!volume_montado(vol)) {
+        return -1;
+    }
+
+    // Determina o tamanho do arquivo fonte
+    struct stat st;
+    if (stat(source_filename, &st) != 0) {
+        perror("Erro ao abrir arquivo fonte");
+        return -1;
+    }
+    if (!S_ISREG(st.st_mode)) {
+        printf("Erro: '%s' não é um arquivo regular (use a importação em fluxo)\n", source_filename);
+        return -1;
+    }
+    off_t file_size = st.st_size;
+    if (file_size < 0 || (uint64_t)file_size > UINT32_MAX) {
+        printf("Erro: Arquivo grande demais para o sistema de arquivos\n");
+        return -1;
+    }
+
+    size_t bps = vol->bytes_per_sector;
+
+    // Arquivos minúsculos ficam na entrada; caudas curtas, em fragmentos
+    imp->embutido = vol->empacotar && file_size > 0 && (uint64_t)file_size <= EMBUTIDO_MAX;
+    uint32_t cauda = imp->embutido ? 0 : (uint32_t)(file_size % bps);
+    if (!empacotar_cauda(vol, (uint64_t)file_size, cauda)) {
+        cauda = 0;
+    }
+
+    // Arquivos de até um setor continuam empacotados. Os comprimidos
+    // reservam o pior caso (nenhum bloco diminui); o excedente volta ao
+    // bitmap ao inserir a entrada.
+    imp->comprimido = vol->comprimir && (uint64_t)file_size > bps &&
+                      maximo_comprimido((uint64_t)file_size) <= UINT32_MAX;
+    uint64_t bytes_reservados = (uint64_t)file_size - cauda;
+    if (imp->comprimido) {
+        cauda = 0;
+        bytes_reservados = maximo_comprimido((uint64_t)file_size);
+    }
+
+    // Calcula a quantidade de setores necessários (arredondando para cima)
+    uint32_t sectors_needed = imp->embutido ? 0 : (uint32_t)((bytes_reservados + bps - 1) / bps);
+
+    // Rejeita cedo, pelo resumo do boot record, antes de abrir o arquivo
+    if (sectors_needed > vol->br->free_sectors) {
+        printf("Erro: Espaço insuficiente no disco\n");
+        return -1;
+    }
+
+    // Verifica duplicatas e a disponibilidade de entrada antes de gravar os dados
+    montar_chave(source_filename, imp->chave);
+    if (dirindex_buscar(&vol->nomes, vol->dir, imp->chave) != -1) {
+        printf("Erro: Arquivo já existe no diretório\n");
+        return -1;
+    }
+
+    if (vol->nomes.free_count == 0) {
+        printf("Erro: Diretório cheio\n");
+        return -1;
+    }
+
+    // Abre o arquivo fonte em modo binário; o tamanho é conferido de novo
+    // pelo descritor, caso o arquivo tenha mudado desde o stat
+    int src = open(source_filename, O_RDONLY);
+    if (src < 0) {
+        perror("Erro ao abrir arquivo fonte");
+        return -1;
+    }
+    if (fstat(src, &st) != 0 || st.st_size != file_size) {
+        printf("Erro: Arquivo fonte alterado durante a importação\n");
+        close(src);
+        return -1;
+    }
+
+    // Reserva os setores: uma faixa contígua quando possível, senão várias
+    uint64_t inicio = agora_ns();
+    int r = alocar_extents_confirmando(vol, sectors_needed, &imp->extents, &imp->extent_count);
+    if (r == 0 && cauda > 0 && alocar_fragmento(vol, cauda, &imp->cauda_setor, &imp->cauda_offset) != 0) {
+        for (uint32_t i = 0; i < imp->extent_count; i++) {
+            liberar_setores(vol, imp->extents[i].start, imp->extents[i].count);
+        }
+        free(imp->extents);
+        imp->extents = NULL;
+        r = -1;
+    }
+    ESTAT(ns_alocacao, agora_ns() - inicio);
+    if (r != 0) {
+        printf("Erro: Espaço insuficiente no disco\n");
+        close(src);
+        return -1;
+    }
+
+    imp->cauda = cauda;
+    imp->src = src;
+    imp->size = (uint64_t)file_size;
+    return 0;
+}
+
+// Abre o arquivo fonte, valida o nome e reserva os setores. Nada é
+// inserido no diretório até concluir_importacao.
+static int preparar_importacao(Volume *vol, const char *source_filename, Importacao *imp) {
+    EstatEscopo e;
+    estat_iniciar(&e, &vol->estat[OP_IMPORTACAO], 0);
+    if (abrir_importacao(vol, source_filename, imp) != 0) {
+        return estat_concluir(&e, -1);
+    }
+    imp->ns = estat_pausar(&e);
+    return 0;
+}
+
+// Lê o fim do arquivo fonte para a entrada (embutido) ou para a cauda no
+// setor de fragmentos. A leitura é posicional: não depende de onde o motor
+// de E/S deixou a posição corrente de src.
+static int gravar_cauda(Volume *vol, Importacao *imp) {
+    if (imp->embutido) {
+        if (ler_em(imp->src, imp->dados, imp->size, 0) != 0) {
+            perror("Erro ao ler arquivo fonte");
+            return -1;
+        }
+        return 0;
+    }
+    unsigned char *buffer = (unsigned char *)malloc(imp->cauda);
+    if (!buffer) {
+        perror("Erro ao alocar memória para a cauda");
+        return -1;
+    }
+    int status = 0;
+    if (ler_em(imp->src, buffer, imp->cauda, (off_t)(imp->size - imp->cauda)) != 0) {
+        perror("Erro ao ler arquivo fonte");
+        status = -1;
+    } else if (disco_escrever(vol, buffer, imp->cauda,
+                              offset_setor(vol->br, imp->cauda_setor) + imp->cauda_offset, 0) != 0) {
+        perror("Erro ao gravar dados no disco");
+        status = -1;
+    }
+    free(buffer);
+    return status;
+}
+
+// Transfere os dados para os setores reservados (pode rodar em paralelo)
+static int transferir_importacao(Volume *vol, void *tarefa) {
+    Importacao *imp = (Importacao *)tarefa;
+    EstatEscopo e;
+    estat_iniciar(&e, &vol->estat[OP_IMPORTACAO], 0);
+    imp->status = 0;
+    if (imp->comprimido) {
+        imp->status = gravar_comprimido(vol, imp->src, imp->extents, imp->extent_count, imp->size, &imp->armazenado);
+    } else if (imp->extent_count > 0) {
+        imp->status = gravar_dados(vol, imp->src, imp->extents, imp->extent_count, imp->size - imp->cauda);
+    }
+    if (imp->status == 0 && (imp->embutido || imp->cauda > 0)) {
+        imp->status = gravar_cauda(vol, imp);
+    }
+    uint64_t ns = estat_pausar(&e);
+    estat_somar(&vol->estat[OP_IMPORTACAO].ns_dados, ns);
+    imp->ns += ns;
+    return imp->status;
+}
+
+static int inserir_importacao(Volume *vol, Importacao *imp) {
+    close(imp->src);
+    imp->src = -1;
+
+    // Outra importação do mesmo lote pode ter ocupado o nome ou a última entrada
+    if (imp->status == 0 && dirindex_buscar(&vol->nomes, vol->dir, imp->chave) != -1) {
+        printf("Erro: Arquivo já existe no diretório\n");
+        imp->status = -1;
+    } else if (imp->status == 0 && vol->nomes.free_count == 0) {
+        printf("Erro: Diretório cheio\n");
+        imp->status = -1;
+    }
+
+    // Preenche nova entrada no diretório
+    DirEntry new_entry;
+    new_entry.status = 0x00; // Válido
+
+    // Nome e extensão do arquivo
+    memcpy(new_entry.filename, imp->chave, NOME_CHAVE);
+
+    new_entry.attributes = 0; // Atributo padrão
+    new_entry.file_size = (unsigned int)imp->size;
+    new_entry.tail_sector = 0;
+    new_entry.tail_offset = 0;
+    new_entry.tail_length = 0;
+
+    // Blocos comprimidos: só os setores ocupados ficam com o arquivo
+    if (imp->status == 0 && imp->comprimido) {
+        uint64_t bps = vol->bytes_per_sector;
+        cortar_extents(vol, imp->extents, &imp->extent_count, (imp->armazenado + bps - 1) / bps);
+        new_entry.attributes |= ATRIB_COMPRIMIDO;
+    }
+
+    // Extents na entrada; os excedentes vão para blocos de extents
+    if (imp->status == 0 && gravar_extents(vol, &new_entry, imp->extents, imp->extent_count) != 0) {
+        printf("Erro: Espaço insuficiente no disco\n");
+        imp->status = -1;
+    }
+    if (imp->status != 0) {
+        for (uint32_t i = 0; i < imp->extent_count; i++) {
+            liberar_setores(vol, imp->extents[i].start, imp->extents[i].count);
+        }
+        if (imp->cauda > 0) {
+            liberar_fragmento(vol, imp->cauda_setor, imp->cauda_offset, imp->cauda);
+        }
+        free(imp->extents);
+        imp->extents = NULL;
+        return -1;
+    }
+    free(imp->extents);
+    imp->extents = NULL;
+
+    // Conteúdo embutido ou posição da cauda (gravar_extents zerou essa área)
+    if (imp->embutido) {
+        new_entry.attributes |= ATRIB_EMBUTIDO;
+        memcpy(dados_embutidos(&new_entry), imp->dados, imp->size);
+    } else if (imp->cauda > 0) {
+        new_entry.attributes |= ATRIB_CAUDA;
+        new_entry.tail_sector = imp->cauda_setor;
+        new_entry.tail_offset = (unsigned short)imp->cauda_offset;
+        new_entry.tail_length = (unsigned short)imp->cauda;
+    }
+
+    // Insere nova entrada na posição livre e no índice de nomes
+    DirEntry *dir = vol->dir;
+    int free_entry_index = vol->nomes.free_slots[--vol->nomes.free_count];
+    dir[free_entry_index] = new_entry;
+    dirindex_inserir(&vol->nomes, dir, free_entry_index);
+    marcar_entrada_suja(vol, free_entry_index);
+    vol->barreira_dados = 1;
+
+    // Atualiza o boot record
+    vol->br->file_count++;
+    marcar_boot_sujo(vol);
+
+    // Metadados alterados em memória; gravados na próxima sincronização
+    operacao_concluida(vol);
+
+    printf("Arquivo copiado para o sistema de arquivos com sucesso!\n");
+    return 0;
+}
+
+// Insere a entrada do arquivo importado ou, se a transferência falhou,
+// devolve os setores reservados
+static int concluir_importacao(Volume *vol, Importacao *imp) {
+    EstatEscopo e;
+    estat_iniciar(&e, &vol->estat[OP_IMPORTACAO], imp->ns);
+    return estat_concluir(&e, inserir_importacao(vol, imp));
+}
+
+int copiar_para_sa(Volume *vol, const char *source_filename) {
+    Importacao imp;
+    if (preparar_importacao(vol, source_filename, &imp) != 0) {
+        return -1;
+    }
+
+    // Escreve dados do arquivo na área de dados, um extent por vez
+    Medicao medicao;
+    medicao_iniciar(&medicao);
+    if (transferir_importacao(vol, &imp) == 0) {
+        medicao_relatar(vol, &medicao, "importação", imp.size);
+    }
+    return concluir_importacao(vol, &imp);
+}
+
+// Procura a entrada válida cujo "nome.extensão" corresponde a filename
+static int buscar_entrada(Volume *vol, const char *filename) {
+    char chave[NOME_CHAVE];
+    montar_chave(filename, chave);
+    return dirindex_buscar(&vol->nomes, vol->dir, chave);
+}
+
+// Exportação em andamento: arquivo de saída aberto e extents carregados
+typedef struct {
+    const char *nome;          // nome do arquivo no volume e de saída
+    int out;                   // descritor do arquivo de saída
+    uint64_t size;             // tamanho do arquivo em bytes
+    FileExtent *extents;       // extents do arquivo no volume
+    uint32_t extent_count;
+    DirEntry entrada;          // cópia da entrada (cauda ou conteúdo embutido)
+    int status;                // resultado da transferência dos dados
+    uint64_t ns;               // tempo gasto até aqui (preparação e transferência)
+} Exportacao;
+
+static int abrir_exportacao(Volume *vol, const char *target_filename, Exportacao *exp) {
+    memset(exp, 0, sizeof(Exportacao));
+    exp->nome = target_filename;
+    exp->out = -1;
+    if (!volume_montado(vol)) {
+        return -1;
+    }
+
+    // Procura por entrada cujo nome e extensão correspondam ao target_filename
+    int found_index = buscar_entrada(vol, target_filename);
+    if (found_index == -1){
+        printf("Arquivo não encontrado no diretório\n");
+        return -1;
+    }
+
+    // Obtém dados do arquivo encontrado
+    DirEntry file_entry = vol->dir[found_index];
+    if ((file_entry.attributes & ATRIB_CAUDA) && file_entry.tail_length > file_entry.file_size) {
+        printf("Erro: Entrada do diretório corrompida\n");
+        return -1;
+    }
+
+    // Abre arquivo de saída com mesmo nome do target_filename
+    int out = open(target_filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (out < 0){
+        perror("Erro ao abrir arquivo de saída");
+        return -1;
+    }
+
+    // Carrega a lista de extents do arquivo
+    if (carregar_extents(vol, &file_entry, &exp->extents, &exp->extent_count) != 0) {
+        close(out);
+        return -1;
+    }
+    exp->out = out;
+    exp->size = file_entry.file_size;
+    exp->entrada = file_entry;
+    return 0;
+}
+
+static int preparar_exportacao(Volume *vol, const char *target_filename, Exportacao *exp) {
+    EstatEscopo e;
+    estat_iniciar(&e, &vol->estat[OP_EXPORTACAO], 0);
+    if (abrir_exportacao(vol, target_filename, exp) != 0) {
+        return estat_concluir(&e, -1);
+    }
+    exp->ns = estat_pausar(&e);
+    return 0;
+}
+
+// Escreve o conteúdo embutido ou a cauda no fim do arquivo de saída
+static int ler_cauda(Volume *vol, Exportacao *exp) {
+    DirEntry *entry = &exp->entrada;
+    if (entry->attributes & ATRIB_EMBUTIDO) {
+        if (escrever_em(exp->out, dados_embutidos(entry), exp->size, 0) != 0) {
+            perror("Erro ao escrever arquivo de saída");
+            return -1;
+        }
+        return 0;
+    }
+    uint32_t cauda = entry->tail_length;
+    unsigned char *buffer = (unsigned char *)malloc(cauda);
+    if (!buffer) {
+        perror("Erro ao alocar memória para a cauda");
+        return -1;
+    }
+    int status = 0;
+    if (disco_ler(vol, buffer, cauda, offset_setor(vol->br, entry->tail_sector) + entry->tail_offset) != 0) {
+        perror("Erro ao ler setor do arquivo");
+        status = -1;
+    } else if (escrever_em(exp->out, buffer, cauda, (off_t)(exp->size - cauda)) != 0) {
+        perror("Erro ao escrever arquivo de saída");
+        status = -1;
+    }
+    free(buffer);
+    return status;
+}
+
+// Lê cada extent sequencialmente e escreve no arquivo de saída (pode rodar em paralelo)
+static int transferir_exportacao(Volume *vol, void *tarefa) {
+    Exportacao *exp = (Exportacao *)tarefa;
+    EstatEscopo e;
+    estat_iniciar(&e, &vol->estat[OP_EXPORTACAO], 0);
+    int fim_separado = (exp->entrada.attributes & (ATRIB_EMBUTIDO | ATRIB_CAUDA)) != 0;
+    uint64_t corpo = exp->size;
+    if (exp->entrada.attributes & ATRIB_EMBUTIDO) {
+        corpo = 0;
+    } else if (exp->entrada.attributes & ATRIB_CAUDA) {
+        corpo -= exp->entrada.tail_length;
+    }
+    exp->status = 0;
+    if (exp->entrada.attributes & ATRIB_COMPRIMIDO) {
+        exp->status = ler_comprimido(vol, exp->out, exp->extents, exp->extent_count, exp->size);
+    } else if (corpo > 0) {
+        exp->status = ler_dados(vol, exp->out, exp->extents, exp->extent_count, corpo);
+    }
+    if (exp->status == 0 && fim_separado) {
+        exp->status = ler_cauda(vol, exp);
+    }
+    uint64_t ns = estat_pausar(&e);
+    estat_somar(&vol->estat[OP_EXPORTACAO].ns_dados, ns);
+    exp->ns += ns;
+    return exp->status;
+}
+
+static int concluir_exportacao(Volume *vol, Exportacao *exp) {
+    EstatEscopo e;
+    estat_iniciar(&e, &vol->estat[OP_EXPORTACAO], exp->ns);
+    free(exp->extents);
+    exp->extents = NULL;
+    close(exp->out);
+    exp->out = -1;
+    if (exp->status != 0) {
+        return estat_concluir(&e, -1);
+    }
+    printf("Arquivo copiado para o sistema com sucesso!\n");
+    return estat_concluir(&e, 0);
+}
+
+int copiar_para_disco(Volume *vol, const char *target_filename){
+    Exportacao exp;
+    if (preparar_exportacao(vol, target_filename, &exp) != 0) {
+        return -1;
+    }
+
+    Medicao medicao;
+    medicao_iniciar(&medicao);
+    if (transferir_exportacao(vol, &exp) == 0) {
+        medicao_relatar(vol, &medicao, "exportação", exp.size);
+    }
+    return concluir_exportacao(vol, &exp);
+}
+
+// ---------------------------------------------------------------------------
+// Transferências paralelas
+//
+// Em lote, os arquivos são processados em rodadas de até JANELA_PARALELA:
+// a thread principal reserva os setores de cada arquivo (alocação e
+// diretório nunca são acessados por mais de uma thread), as threads de
+// transferência copiam os dados com pread/pwrite posicionais em extents
+// distintos e, por fim, a thread principal insere as entradas.
+// ---------------------------------------------------------------------------
+
+typedef struct {
+    Volume *vol;
+    unsigned char *tarefas;    // vetor de tarefas de 'tamanho' bytes cada
+    size_t tamanho;
+    uint32_t quantidade;
+    uint32_t proxima;          // próxima tarefa livre (incremento atômico)
+    int (*transferir)(Volume *, void *);
+} Rodada;
+
+static void *thread_transferencia(void *arg) {
+    Rodada *r = (Rodada *)arg;
+    for (;;) {
+        uint32_t i = __atomic_fetch_add(&r->proxima, 1, __ATOMIC_RELAXED);
+        if (i >= r->quantidade) break;
+        r->transferir(r->vol, r->tarefas + (size_t)i * r->tamanho);
+    }
+    return NULL;
+}
+
+// Executa transferir() sobre as tarefas com até vol->threads threads
+static void executar_rodada(Volume *vol, void *tarefas, size_t tamanho, uint32_t quantidade,
+                            int (*transferir)(Volume *, void *)) {
+    Rodada r = {vol, (unsigned char *)tarefas, tamanho, quantidade, 0, transferir};
+    uint32_t n = (uint32_t)vol->threads < quantidade ? (uint32_t)vol->threads : quantidade;
+    pthread_t threads[THREADS_MAX];
+    uint32_t criadas = 0;
+    for (uint32_t t = 1; t < n; t++) {
+        if (pthread_create(&threads[criadas], NULL, thread_transferencia, &r) != 0) break;
+        criadas++;
+    }
+    // A thread principal também transfere
+    thread_transferencia(&r);
+    for (uint32_t t = 0; t < criadas; t++) {
+        pthread_join(threads[t], NULL);
+    }
+}
+
+// A rodada para de crescer antes que suas alterações excedam o journal
+static int rodada_cheia(const Volume *vol, uint32_t preparadas) {
+    return preparadas >= JANELA_PARALELA ||
+           (preparadas > 0 && vol->journal_cap > 0 && vol->dirty_count > vol->journal_cap / 2);
+}
+
+// Importa os arquivos em rodadas paralelas; retorna a quantidade de falhas
+int importar_arquivos(Volume *vol, char **nomes, int quantidade) {
+    Importacao *imp = (Importacao *)malloc(JANELA_PARALELA * sizeof(Importacao));
+    if (!imp) {
+        perror("Erro ao alocar memória para importação");
+        return quantidade;
+    }
+    Medicao medicao;
+    medicao_iniciar(&medicao);
+    uint64_t bytes = 0;
+    int falhas = 0;
+    int i = 0;
+    while (i < quantidade) {
+        uint32_t preparadas = 0;
+        while (i < quantidade && !rodada_cheia(vol, preparadas)) {
+            if (preparar_importacao(vol, nomes[i], &imp[preparadas]) == 0) {
+                preparadas++;
+            } else {
+                falhas++;
+            }
+            i++;
+        }
+        executar_rodada(vol, imp, sizeof(Importacao), preparadas, transferir_importacao);
+        for (uint32_t k = 0; k < preparadas; k++) {
+            if (concluir_importacao(vol, &imp[k]) == 0) {
+                bytes += imp[k].size;
+            } else {
+                falhas++;
+            }
+        }
+    }
+    free(imp);
+    medicao_relatar(vol, &medicao, "importação em lote", bytes);
+    return falhas;
+}
+
+// Exporta os arquivos em rodadas paralelas; retorna a quantidade de falhas
+int exportar_arquivos(Volume *vol, char **nomes, int quantidade) {
+    Exportacao *exp = (Exportacao *)malloc(JANELA_PARALELA * sizeof(Exportacao));
+    if (!exp) {
+        perror("Erro ao alocar memória para exportação");
+        return quantidade;
+    }
+    Medicao medicao;
+    medicao_iniciar(&medicao);
+    uint64_t bytes = 0;
+    int falhas = 0;
+    int i = 0;
+    while (i < quantidade) {
+        uint32_t preparadas = 0;
+        while (i < quantidade && preparadas < JANELA_PARALELA) {
+            if (preparar_exportacao(vol, nomes[i], &exp[preparadas]) == 0) {
+                preparadas++;
+            } else {
+                falhas++;
+            }
+            i++;
+        }
+        executar_rodada(vol, exp, sizeof(Exportacao), preparadas, transferir_exportacao);
+        for (uint32_t k = 0; k < preparadas; k++) {
+            if (concluir_exportacao(vol, &exp[k]) == 0) {
+                bytes += exp[k].size;
+            } else {
+                falhas++;
+            }
+        }
+    }
+    free(exp);
+    medicao_relatar(vol, &medicao, "exportação em lote", bytes);
+    return falhas;
+}
+
+static int exibir_listagem(Volume *vol) {
+    DirEntry *directory = vol->dir;
+
+    // Cabeçalho para listagem
+    printf("\n--- Listagem de Arquivos ---\n");
+    int arquivo_encontrado = 0;
+
+    // Percorrer todas as entradas do diretório
+    for (int i = 0; i < vol->dir_entries; i++){
+
+        if (directory[i].status == 0x00 &&
+            directory[i].file_size > 0 &&
+            strlen(directory[i].filename) > 0 &&
+            strcmp(directory[i].filename, ".") != 0) {
+
+            arquivo_encontrado = 1;
+            printf("Arquivo %d:\n", i + 1);
+            printf("  Nome: %s.%s\n", directory[i].filename, directory[i].extension);
+            printf("  Atributos: %d\n", directory[i].attributes);
+            printf("  Setor inicial: %u\n", directory[i].first_sector);
+            printf("  Extents: %u\n", directory[i].extent_count);
+            printf("  Tamanho: %u bytes\n", directory[i].file_size);
+            exibir_armazenamento(&directory[i]);
+        }
+    }
+
+    if(!arquivo_encontrado){
+        printf("Nenhum arquivo encontrado no diretório\n");
+    }
+    return 0;
+}
+
+int listar_arquivos(Volume *vol){
+    if (!volume_montado(vol)) {
+        return -1;
+    }
+    EstatEscopo e;
+    estat_iniciar(&e, &vol->estat[OP_LISTAGEM], 0);
+    return estat_concluir(&e, exibir_listagem(vol));
+}
+
+static int remover_entrada(Volume *vol, const char *filename) {
+    // Procura por entrada cujo nome e extensão correspondam ao filename
+    int found_index = buscar_entrada(vol, filename);
+    if (found_index == -1){
+        printf("Arquivo não encontrado no diretório\n");
+        return -1;
+    }
+
+    DirEntry *directory = vol->dir;
+
+    // Obtém entrada correspondente ao arquivo encontrado
+    DirEntry file_entry = directory[found_index];
+
+    // Libera os extents e blocos de extents no bitmap e no índice de faixas livres
+    if (liberar_arquivo(vol, &file_entry) != 0) {
+        return -1;
+    }
+
+    // Marca entrada do diretório como deletada e a devolve à pilha de livres
+    dirindex_remover(&vol->nomes, directory, found_index);
+    vol->nomes.free_slots[vol->nomes.free_count++] = found_index;
+    memset(&directory[found_index], 0, sizeof(DirEntry));
+    directory[found_index].status = 0xFF;
+    marcar_entrada_suja(vol, found_index);
+
+    // Atualiza o boot record
+    if (vol->br->file_count > 0){
+        vol->br->file_count--;
+        marcar_boot_sujo(vol);
+    }
+
+    operacao_concluida(vol);
+
+    printf("Arquivo '%s' removido com sucesso!\n", filename);
+    return 0;
+}
+
+int remover_arquivo(Volume *vol, const char *filename){
+    if (!volume_montado(vol)) {
+        return -1;
+    }
+    EstatEscopo e;
+    estat_iniciar(&e, &vol->estat[OP_REMOCAO], 0);
+    return estat_concluir(&e, remover_entrada(vol, filename));
+}
+
+// ---------------------------------------------------------------------------
+// Arquivos abertos
+//
+// Um SaArquivo guarda a posição da entrada no diretório e o nome como
+// gravado, conferidos a cada chamada: se o arquivo foi removido e a entrada
+// reaproveitada, as chamadas falham com ESTALE. A lista de extents fica
+// carregada no arquivo aberto enquanto a entrada não mudar, de modo que uma
+// leitura de poucos bytes em um arquivo grande custa apenas a leitura dos
+// setores que contêm esses bytes (pelo cache de blocos).
+//
+// A primeira escrita ou truncamento de um arquivo empacotado move o
+// conteúdo embutido ou a cauda para um setor próprio, e a partir daí o
+// arquivo inteiro é coberto pelos extents. Crescimentos reservam setores com
+// alocar_extents, unindo faixas adjacentes, e preenchem com zeros o
+// intervalo entre o fim anterior e o início da escrita; os bytes além de
+// file_size no último setor não têm valor definido.
+//
+// Um arquivo comprimido é lido bloco a bloco (a tabela fica carregada com
+// os extents) e, na primeira alteração, regravado sem compressão.
+//
+// Um arquivo que cresce ocupa primeiro os setores livres logo após o seu
+// último extent, de modo que acréscimos sucessivos (arquivos de log)
+// estendem a mesma faixa; só quando ela esbarra em setores ocupados o
+// restante vai para novos extents. sa_reservar aloca setores além do fim do
+// arquivo para o crescimento esperado: a lista de extents pode cobrir mais
+// que file_size, e as exportações, a desfragmentação e a remoção tratam
+// esses setores como parte do arquivo. Os metadados seguem o intervalo de
+// sincronização do volume, como nas importações.
+// ---------------------------------------------------------------------------
+
+struct SaArquivo {
+    Volume *vol;
+    int indice;                // entrada do diretório
+    int modo;                  // SA_ESCRITA, SA_CRIAR, SA_TRUNCAR
+    char chave[NOME_CHAVE];    // nome e extensão como gravados na entrada
+    FileExtent *extents;       // lista carregada da entrada em 'versao'
+    uint32_t extent_count;
+    int carregado;             // extents válidos para 'versao'
+    DirEntry versao;           // entrada no momento da carga
+    uint32_t *tabela;          // posições dos blocos comprimidos, da mesma 'versao'
+    unsigned char *bloco;      // último bloco descomprimido, seguido da área de leitura
+    uint32_t bloco_indice;     // bloco guardado em 'bloco'
+    int bloco_carregado;
+};
+
+// Entrada do arquivo aberto, ou NULL se o volume foi desmontado ou o
+// arquivo removido
+static DirEntry *entrada_aberta(SaArquivo *arq) {
+    Volume *vol = arq->vol;
+    if (!vol->meta) {
+        errno = EBADF;
+        return NULL;
+    }
+    if (arq->indice >= vol->dir_entries || vol->dir[arq->indice].status != 0x00 ||
+        memcmp(vol->dir[arq->indice].filename, arq->chave, NOME_CHAVE) != 0) {
+        errno = ESTALE;
+        return NULL;
+    }
+    return &vol->dir[arq->indice];
+}
+
+// Lista de extents da entrada, recarregada se a entrada mudou (escrita por
+// outro arquivo aberto, desfragmentação)
+static int extents_abertos(SaArquivo *arq, DirEntry *entry) {
+    if (arq->carregado && memcmp(&arq->versao, entry, sizeof(DirEntry)) == 0) {
+        return 0;
+    }
+    free(arq->extents);
+    free(arq->tabela);
+    arq->extents = NULL;
+    arq->tabela = NULL;
+    arq->carregado = 0;
+    arq->bloco_carregado = 0;
+    if (carregar_extents(arq->vol, entry, &arq->extents, &arq->extent_count) != 0) {
+        errno = EIO;
+        return -1;
+    }
+    arq->versao = *entry;
+    arq->carregado = 1;
+    return 0;
+}
+
+// Bloco i do arquivo comprimido, descomprimido em arq->bloco. O último
+// bloco fica guardado: leituras pequenas e sequenciais não o descomprimem
+// de novo.
+static int bloco_aberto(SaArquivo *arq, DirEntry *entry, uint32_t i) {
+    Volume *vol = arq->vol;
+    if (extents_abertos(arq, entry) != 0) {
+        return -1;
+    }
+    if (arq->bloco_carregado && arq->bloco_indice == i) {
+        return 0;
+    }
+    if (!arq->tabela &&
+        !(arq->tabela = carregar_tabela(vol, arq->extents, arq->extent_count, entry->file_size, 0))) {
+        return -1;
+    }
+    if (!arq->bloco && !(arq->bloco = (unsigned char *)malloc(2 * BLOCO_COMPRESSAO))) {
+        errno = ENOMEM;
+        return -1;
+    }
+    unsigned char *dados = arq->bloco + BLOCO_COMPRESSAO;
+    arq->bloco_carregado = 0;
+    if (acessar_extents(vol, arq->extents, arq->extent_count, arq->tabela[i], dados,
+                        arq->tabela[i + 1] - arq->tabela[i], 0, 0) != 0 ||
+        expandir_bloco(arq->tabela, entry->file_size, i, dados, arq->bloco) != 0) {
+        return -1;
+    }
+    arq->bloco_indice = i;
+    arq->bloco_carregado = 1;
+    return 0;
+}
+
+// Preenche com zeros o intervalo [inicio, fim) coberto pelos extents
+static int zerar_extents(Volume *vol, const FileExtent *lista, uint32_t qtd, uint64_t inicio, uint64_t fim) {
+    size_t bloco = fim - inicio < vol->transfer_size ? (size_t)(fim - inicio) : vol->transfer_size;
+    unsigned char *zeros = (unsigned char *)calloc(1, bloco);
+    if (!zeros) {
+        return -1;
+    }
+    int r = 0;
+    while (r == 0 && inicio < fim) {
+        size_t n = fim - inicio < bloco ? (size_t)(fim - inicio) : bloco;
+        r = acessar_extents(vol, lista, qtd, inicio, zeros, n, ESCRITA_NOVA, 0);
+        inicio += n;
+    }
+    free(zeros);
+    return r;
+}
+
+// Regrava o arquivo comprimido, sem compressão, em setores novos; os
+// setores comprimidos só são liberados depois que a entrada aponta para os
+// novos
+static int descomprimir(SaArquivo *arq, DirEntry *entry) {
+    Volume *vol = arq->vol;
+    uint64_t size = entry->file_size;
+    uint64_t bps = vol->bytes_per_sector;
+    if (extents_abertos(arq, entry) != 0) {
+        return -1;
+    }
+    FileExtent *novos;
+    uint32_t n_novos;
+    if (alocar_extents_confirmando(vol, (uint32_t)((size + bps - 1) / bps), &novos, &n_novos) != 0) {
+        errno = ENOSPC;
+        return -1;
+    }
+    int r = 0;
+    if (n_novos > MAX_EXTENTS) {
+        errno = EFBIG;
+        r = -1;
+    }
+    for (uint32_t i = 0; i < blocos_compressao(size) && r == 0; i++) {
+        r = bloco_aberto(arq, entry, i);
+        if (r == 0) {
+            r = acessar_extents(vol, novos, n_novos, (uint64_t)i * BLOCO_COMPRESSAO,
+                                arq->bloco, tamanho_bloco(size, i), ESCRITA_NOVA, 0);
+        }
+    }
+    if (r == 0 && substituir_extents(vol, arq->indice, novos, n_novos) != 0) {
+        errno = ENOSPC;
+        r = -1;
+    }
+    if (r != 0) {
+        for (uint32_t e = 0; e < n_novos; e++) {
+            liberar_setores(vol, novos[e].start, novos[e].count);
+        }
+        free(novos);
+        return -1;
+    }
+    free(novos);
+
+    for (uint32_t e = 0; e < arq->extent_count; e++) {
+        liberar_setores(vol, arq->extents[e].start, arq->extents[e].count);
+    }
+    entry->attributes &= (unsigned char)~ATRIB_COMPRIMIDO;
+    marcar_entrada_suja(vol, arq->indice);
+    vol->barreira_dados = 1;
+    return 0;
+}
+
+// Move o conteúdo embutido ou a cauda para um setor próprio no fim da lista
+// de extents, deixando o arquivo inteiro coberto pelos extents. Um arquivo
+// comprimido é descomprimido.
+static int desempacotar(SaArquivo *arq, DirEntry *entry) {
+    Volume *vol = arq->vol;
+    if (entry->attributes & ATRIB_COMPRIMIDO) {
+        return descomprimir(arq, entry);
+    }
+    if (!(entry->attributes & (ATRIB_EMBUTIDO | ATRIB_CAUDA))) {
+        return 0;
+    }
+    if (extents_abertos(arq, entry) != 0) {
+        return -1;
+    }
+    if (arq->extent_count >= MAX_EXTENTS) {
+        errno = EFBIG;
+        return -1;
+    }
+
+    uint32_t bps = vol->bytes_per_sector;
+    unsigned char *setor = (unsigned char *)calloc(1, bps);
+    FileExtent *lista = (FileExtent *)malloc((arq->extent_count + 1) * sizeof(FileExtent));
+    if (!setor || !lista) {
+        free(setor);
+        free(lista);
+        errno = ENOMEM;
+        return -1;
+    }
+    if (entry->attributes & ATRIB_EMBUTIDO) {
+        memcpy(setor, dados_embutidos(entry), entry->file_size);
+    } else if (disco_ler(vol, setor, entry->tail_length,
+                         offset_setor(vol->br, entry->tail_sector) + entry->tail_offset) != 0) {
+        free(setor);
+        free(lista);
+        errno = EIO;
+        return -1;
+    }
+
+    // De preferência logo após o último extent, que então só cresce
+    uint32_t inicio = 0;
+    if (arq->extent_count > 0) {
+        inicio = arq->extents[arq->extent_count - 1].start + arq->extents[arq->extent_count - 1].count;
+    }
+    if ((inicio == 0 || estender_setores(vol, inicio, 1) == 0) && alocar_setores(vol, 1, &inicio) != 0) {
+        free(setor);
+        free(lista);
+        errno = ENOSPC;
+        return -1;
+    }
+    FileExtent novo = {inicio, 1};
+    memcpy(lista, arq->extents, arq->extent_count * sizeof(FileExtent));
+    uint32_t qtd = anexar_extents(lista, arq->extent_count, &novo, 1);
+    int r = disco_escrever(vol, setor, bps, offset_setor(vol->br, novo.start), 1);
+    free(setor);
+    if (r != 0 || substituir_extents(vol, arq->indice, lista, qtd) != 0) {
+        liberar_setores(vol, novo.start, 1);
+        free(lista);
+        errno = r != 0 ? EIO : ENOSPC;
+        return -1;
+    }
+    free(lista);
+
+    if (entry->attributes & ATRIB_CAUDA) {
+        liberar_fragmento(vol, entry->tail_sector, entry->tail_offset, entry->tail_length);
+    }
+    entry->attributes &= (unsigned char)~(ATRIB_EMBUTIDO | ATRIB_CAUDA);
+    entry->tail_sector = 0;
+    entry->tail_offset = 0;
+    entry->tail_length = 0;
+    marcar_entrada_suja(vol, arq->indice);
+    vol->barreira_dados = 1;
+    return 0;
+}
+
+// Leva o arquivo a 'tamanho' bytes, com pelo menos 'reserva' bytes de
+// setores alocados, e, com 'buf', grava 'len' bytes em 'off'. Os setores que
+// faltam são ocupados primeiro logo após o último extent e só então em
+// novos extents; os que sobram são liberados apenas com 'cortar'
+// (truncamento). O intervalo entre o fim anterior e o novo conteúdo é
+// preenchido com zeros. Em caso de erro a entrada fica como estava (exceto
+// pelo desempacotamento).
+static int alterar_arquivo(SaArquivo *arq, uint64_t tamanho, uint64_t reserva, int cortar,
+                           const void *buf, size_t len, uint64_t off) {
+    Volume *vol = arq->vol;
+    DirEntry *entry = entrada_aberta(arq);
+    if (!entry || desempacotar(arq, entry) != 0 || extents_abertos(arq, entry) != 0) {
+        return -1;
+    }
+
+    uint64_t bps = vol->bytes_per_sector;
+    uint64_t anterior = entry->file_size;
+    uint64_t atuais = 0;
+    for (uint32_t e = 0; e < arq->extent_count; e++) atuais += arq->extents[e].count;
+    uint64_t necessarios = ((tamanho > reserva ? tamanho : reserva) + bps - 1) / bps;
+    if (!cortar && necessarios < atuais) {
+        necessarios = atuais;
+    }
+
+    // Setores que faltam: primeiro os livres logo após o último extent (o
+    // arquivo cresce no lugar), depois novos extents
+    FileExtent *novos = NULL;
+    uint32_t n_novos = 0;
+    uint32_t fim = 0;
+    uint32_t estendidos = 0;
+    if (necessarios > atuais) {
+        uint64_t inicio = agora_ns();
+        uint32_t falta = (uint32_t)(necessarios - atuais);
+        if (arq->extent_count > 0) {
+            fim = arq->extents[arq->extent_count - 1].start + arq->extents[arq->extent_count - 1].count;
+            estendidos = estender_setores(vol, fim, falta);
+        }
+        int r = alocar_extents_confirmando(vol, falta - estendidos, &novos, &n_novos);
+        ESTAT(ns_alocacao, agora_ns() - inicio);
+        if (r != 0) {
+            liberar_setores(vol, fim, estendidos);
+            errno = ENOSPC;
+            return -1;
+        }
+    }
+    FileExtent *lista = (FileExtent *)malloc((arq->extent_count + n_novos + 1) * sizeof(FileExtent));
+    FileExtent *sobras = (FileExtent *)malloc((arq->extent_count + 1) * sizeof(FileExtent));
+    uint32_t qtd = 0;
+    uint32_t n_sobras = 0;
+    int status = lista && sobras ? 0 : -1;
+    if (status != 0) {
+        errno = ENOMEM;
+    } else if (necessarios >= atuais) {
+        memcpy(lista, arq->extents, arq->extent_count * sizeof(FileExtent));
+        if (estendidos > 0) {
+            lista[arq->extent_count - 1].count += estendidos;
+        }
+        qtd = anexar_extents(lista, arq->extent_count, novos, n_novos);
+    } else {
+        // Corta a lista em 'necessarios' setores; o restante é liberado ao final
+        uint64_t acumulado = 0;
+        for (uint32_t e = 0; e < arq->extent_count; e++) {
+            FileExtent x = arq->extents[e];
+            uint32_t fica = acumulado >= necessarios ? 0
+                          : necessarios - acumulado < x.count ? (uint32_t)(necessarios - acumulado) : x.count;
+            acumulado += x.count;
+            if (fica > 0) {
+                lista[qtd].start = x.start;
+                lista[qtd++].count = fica;
+            }
+            if (fica < x.count) {
+                sobras[n_sobras].start = x.start + fica;
+                sobras[n_sobras++].count = x.count - fica;
+            }
+        }
+    }
+    if (status == 0 && qtd > MAX_EXTENTS) {
+        errno = EFBIG;
+        status = -1;
+    }
+
+    // Zeros entre o fim anterior e o novo conteúdo, depois os dados
+    uint64_t inicio = agora_ns();
+    uint64_t fim_zeros = buf ? off : tamanho;
+    if (status == 0 && fim_zeros > anterior) {
+        status = zerar_extents(vol, lista, qtd, anterior, fim_zeros);
+    }
+    if (status == 0 && buf && len > 0) {
+        status = acessar_extents(vol, lista, qtd, off, (unsigned char *)buf, len,
+                                 off + len >= anterior ? ESCRITA_NOVA : 1, 0);
+    }
+    ESTAT(ns_dados, agora_ns() - inicio);
+    if (status == 0 && (fim_zeros > anterior || (buf && len > 0))) {
+        vol->barreira_dados = 1;
+    }
+
+    int mudou = estendidos > 0 || n_novos > 0 || n_sobras > 0;
+    if (status == 0 && mudou && substituir_extents(vol, arq->indice, lista, qtd) != 0) {
+        errno = ENOSPC;
+        status = -1;
+    }
+    if (status != 0) {
+        liberar_setores(vol, fim, estendidos);
+        for (uint32_t e = 0; e < n_novos; e++) {
+            liberar_setores(vol, novos[e].start, novos[e].count);
+        }
+        free(novos);
+        free(sobras);
+        free(lista);
+        return -1;
+    }
+
+    for (uint32_t e = 0; e < n_sobras; e++) {
+        liberar_setores(vol, sobras[e].start, sobras[e].count);
+    }
+    free(novos);
+    free(sobras);
+    if (tamanho != anterior) {
+        entry->file_size = (unsigned int)tamanho;
+        marcar_entrada_suja(vol, arq->indice);
+    }
+
+    // A lista gravada passa a ser a carregada no arquivo aberto
+    free(arq->extents);
+    arq->extents = lista;
+    arq->extent_count = qtd;
+    arq->versao = *entry;
+    arq->carregado = 1;
+    operacao_concluida(vol);
+    return 0;
+}
+
+// Cria a entrada vazia com o nome 'chave'; retorna sua posição ou -1
+static int criar_entrada(Volume *vol, const char *chave) {
+    if (vol->nomes.free_count == 0) {
+        errno = ENOSPC;
+        return -1;
+    }
+    DirEntry *dir = vol->dir;
+    int i = vol->nomes.free_slots[--vol->nomes.free_count];
+    memset(&dir[i], 0, sizeof(DirEntry));
+    dir[i].status = 0x00;
+    memcpy(dir[i].filename, chave, NOME_CHAVE);
+    dirindex_inserir(&vol->nomes, dir, i);
+    marcar_entrada_suja(vol, i);
+
+    vol->br->file_count++;
+    marcar_boot_sujo(vol);
+    operacao_concluida(vol);
+    return i;
+}
+
+// Abre o arquivo 'nome' do volume (SA_LEITURA, ou SA_ESCRITA, SA_CRIAR e
+// SA_TRUNCAR combinados)
+SaArquivo *sa_abrir(Volume *vol, const char *nome, int modo) {
+    if (!vol || !nome || !*nome) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if (!vol->meta) {
+        errno = EBADF;
+        return NULL;
+    }
+    if (modo & (SA_CRIAR | SA_TRUNCAR)) {
+        modo |= SA_ESCRITA;
+    }
+
+    char chave[NOME_CHAVE];
+    montar_chave(nome, chave);
+    int i = dirindex_buscar(&vol->nomes, vol->dir, chave);
+    if (i == -1 && !(modo & SA_CRIAR)) {
+        errno = ENOENT;
+        return NULL;
+    }
+    SaArquivo *arq = (SaArquivo *)calloc(1, sizeof(SaArquivo));
+    if (!arq) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    if (i == -1 && (i = criar_entrada(vol, chave)) < 0) {
+        free(arq);
+        return NULL;
+    }
+    arq->vol = vol;
+    arq->indice = i;
+    arq->modo = modo;
+    memcpy(arq->chave, chave, NOME_CHAVE);
+
+    if ((modo & SA_TRUNCAR) && sa_truncar(arq, 0) != 0) {
+        int erro = errno;
+        sa_fechar(arq);
+        errno = erro;
+        return NULL;
+    }
+    return arq;
+}
+
+// Fecha o arquivo; os metadados alterados são gravados na próxima
+// sincronização do volume
+int sa_fechar(SaArquivo *arq) {
+    if (!arq) {
+        errno = EINVAL;
+        return -1;
+    }
+    free(arq->extents);
+    free(arq->tabela);
+    free(arq->bloco);
+    free(arq);
+    return 0;
+}
+
+// Lê até 'len' bytes a partir de 'off'; retorna os bytes lidos (0 no fim do arquivo)
+ssize_t sa_ler(SaArquivo *arq, void *buf, size_t len, uint64_t off) {
+    DirEntry *entry = arq ? entrada_aberta(arq) : NULL;
+    if (!entry) {
+        if (!arq) errno = EINVAL;
+        return -1;
+    }
+    uint64_t size = entry->file_size;
+    if (off >= size || len == 0) {
+        return 0;
+    }
+    if (len > size - off) {
+        len = (size_t)(size - off);
+    }
+
+    Volume *vol = arq->vol;
+    EstatEscopo e;
+    estat_iniciar(&e, &vol->estat[OP_LEITURA], 0);
+    unsigned char *p = (unsigned char *)buf;
+    size_t restante = len;
+    int status = 0;
+    if (entry->attributes & ATRIB_EMBUTIDO) {
+        memcpy(p, dados_embutidos(entry) + off, restante);
+        restante = 0;
+    }
+
+    // Arquivo comprimido: apenas os blocos que cobrem o intervalo
+    while ((entry->attributes & ATRIB_COMPRIMIDO) && status == 0 && restante > 0) {
+        uint32_t i = (uint32_t)(off / BLOCO_COMPRESSAO);
+        size_t dentro = (size_t)(off % BLOCO_COMPRESSAO);
+        size_t n = tamanho_bloco(size, i) - dentro < restante ? tamanho_bloco(size, i) - dentro : restante;
+        status = bloco_aberto(arq, entry, i);
+        if (status == 0) {
+            memcpy(p, arq->bloco + dentro, n);
+            p += n;
+            off += n;
+            restante -= n;
+        }
+    }
+
+    // Corpo nos extents, cauda no setor de fragmentos
+    uint64_t corpo = size - ((entry->attributes & ATRIB_CAUDA) ? entry->tail_length : 0);
+    if (status == 0 && restante > 0 && off < corpo) {
+        size_t n = corpo - off < restante ? (size_t)(corpo - off) : restante;
+        status = extents_abertos(arq, entry);
+        if (status == 0) {
+            status = acessar_extents(vol, arq->extents, arq->extent_count, off, p, n, 0, 0);
+        }
+        p += n;
+        off += n;
+        restante -= n;
+    }
+    if (status == 0 && restante > 0 &&
+        disco_ler(vol, p, restante, offset_setor(vol->br, entry->tail_sector) + entry->tail_offset +
+                                    (off_t)(off - corpo)) != 0) {
+        errno = EIO;
+        status = -1;
+    }
+    int erro = errno;
+    estat_concluir(&e, status);
+    errno = erro;
+    return status == 0 ? (ssize_t)len : -1;
+}
+
+// Confere o modo e o limite de tamanho do formato (file_size tem 32 bits)
+static int escrita_permitida(SaArquivo *arq, uint64_t fim) {
+    if (!arq) {
+        errno = EINVAL;
+        return 0;
+    }
+    if (!(arq->modo & SA_ESCRITA)) {
+        errno = EBADF;
+        return 0;
+    }
+    if (fim > UINT32_MAX) {
+        errno = EFBIG;
+        return 0;
+    }
+    return 1;
+}
+
+// Grava 'len' bytes em 'off', estendendo o arquivo se preciso
+ssize_t sa_escrever(SaArquivo *arq, const void *buf, size_t len, uint64_t off) {
+    if (!escrita_permitida(arq, len > UINT32_MAX ? UINT64_MAX : off + len)) {
+        return -1;
+    }
+    DirEntry *entry = entrada_aberta(arq);
+    if (!entry) {
+        return -1;
+    }
+    if (len == 0) {
+        return 0;
+    }
+    uint64_t tamanho = off + len > entry->file_size ? off + len : entry->file_size;
+    EstatEscopo e;
+    estat_iniciar(&e, &arq->vol->estat[OP_ESCRITA], 0);
+    int status = alterar_arquivo(arq, tamanho, 0, 0, buf, len, off);
+    int erro = errno;
+    estat_concluir(&e, status);
+    errno = erro;
+    return status == 0 ? (ssize_t)len : -1;
+}
+
+// Grava 'len' bytes no fim do arquivo
+ssize_t sa_anexar(SaArquivo *arq, const void *buf, size_t len) {
+    DirEntry *entry = arq ? entrada_aberta(arq) : NULL;
+    if (!entry) {
+        if (!arq) errno = EINVAL;
+        return -1;
+    }
+    return sa_escrever(arq, buf, len, entry->file_size);
+}
+
+// Reduz ou estende (com zeros) o arquivo para 'tamanho' bytes; os setores
+// além do novo fim, inclusive os reservados, são liberados
+int sa_truncar(SaArquivo *arq, uint64_t tamanho) {
+    if (!escrita_permitida(arq, tamanho)) {
+        return -1;
+    }
+    DirEntry *entry = entrada_aberta(arq);
+    if (!entry) {
+        return -1;
+    }
+    if (tamanho == entry->file_size && (entry->attributes & (ATRIB_EMBUTIDO | ATRIB_CAUDA | ATRIB_COMPRIMIDO))) {
+        return 0;
+    }
+    EstatEscopo e;
+    estat_iniciar(&e, &arq->vol->estat[OP_ESCRITA], 0);
+    int status = alterar_arquivo(arq, tamanho, 0, 1, NULL, 0, 0);
+    int erro = errno;
+    estat_concluir(&e, status);
+    errno = erro;
+    return status;
+}
+
+// Reserva setores para o arquivo chegar a 'tamanho' bytes sem novas
+// alocações; o tamanho não muda e sa_truncar devolve a reserva
+int sa_reservar(SaArquivo *arq, uint64_t tamanho) {
+    if (!escrita_permitida(arq, tamanho)) {
+        return -1;
+    }
+    DirEntry *entry = entrada_aberta(arq);
+    if (!entry) {
+        return -1;
+    }
+    if (tamanho <= entry->file_size) {
+        return 0;
+    }
+    EstatEscopo e;
+    estat_iniciar(&e, &arq->vol->estat[OP_ESCRITA], 0);
+    int status = alterar_arquivo(arq, entry->file_size, tamanho, 0, NULL, 0, 0);
+    int erro = errno;
+    estat_concluir(&e, status);
+    errno = erro;
+    return status;
+}
+
+int sa_estado(SaArquivo *arq, SaEstado *estado) {
+    DirEntry *entry = arq ? entrada_aberta(arq) : NULL;
+    if (!entry) {
+        if (!arq) errno = EINVAL;
+        return -1;
+    }
+    if (extents_abertos(arq, entry) != 0) {
+        return -1;
+    }
+    memset(estado, 0, sizeof(SaEstado));
+    estado->size = entry->file_size;
+    estado->extent_count = arq->extent_count;
+    for (uint32_t e = 0; e < arq->extent_count; e++) {
+        estado->sectors += arq->extents[e].count;
+    }
+    estado->first_sector = arq->extent_count ? arq->extents[0].start : 0;
+    estado->attributes = entry->attributes;
+    return 0;
+}
+
+// Acrescenta o conteúdo do arquivo externo ao arquivo de mesmo nome no
+// volume, criando-o se não existir; um arquivo criado recebe 'reserva'
+// bytes de setores reservados para os próximos acréscimos
+int anexar_arquivo(Volume *vol, const char *source_filename, uint64_t reserva) {
+    if (!volume_montado(vol)) {
+        return -1;
+    }
+    int src = open(source_filename, O_RDONLY);
+    if (src < 0) {
+        perror("Erro ao abrir arquivo fonte");
+        return -1;
+    }
+    int existia = buscar_entrada(vol, source_filename) != -1;
+    SaArquivo *arq = sa_abrir(vol, source_filename, SA_CRIAR);
+    unsigned char *buffer = arq ? alocar_buffer_transferencia(vol) : NULL;
+    if (!buffer) {
+        perror("Erro ao abrir arquivo no sistema de arquivos");
+        sa_fechar(arq);
+        close(src);
+        return -1;
+    }
+    if (!existia && reserva > 0 && sa_reservar(arq, reserva) != 0) {
+        printf("Aviso: Reserva de %llu bytes não atendida\n", (unsigned long long)reserva);
+    }
+
+    uint64_t total = 0;
+    int status = 0;
+    for (;;) {
+        ssize_t n = ler_sequencial(src, buffer, vol->transfer_size);
+        if (n < 0) {
+            perror("Erro ao ler arquivo fonte");
+            status = -1;
+            break;
+        }
+        if (n == 0) {
+            break;
+        }
+        if (sa_anexar(arq, buffer, (size_t)n) != n) {
+            perror("Erro ao gravar dados no disco");
+            status = -1;
+            break;
+        }
+        total += (uint64_t)n;
+    }
+    free(buffer);
+    sa_fechar(arq);
+    close(src);
+    if (status == 0) {
+        printf("%llu bytes anexados a '%s'\n", (unsigned long long)total, source_filename);
+    }
+    return status;
+}
+
+// ---------------------------------------------------------------------------
+// Importação em fluxo
+//
+// Fontes sem tamanho conhecido (entrada padrão, pipes, sockets) são lidas
+// uma única vez. Os setores são reservados à medida que os dados chegam, em
+// blocos que dobram de tamanho até FLUXO_BLOCO_MAX, e cada bloco estende a
+// última faixa reservada quando os setores seguintes estão livres. Uma
+// thread lê a fonte em um de dois buffers enquanto a thread principal grava
+// o outro na imagem, fora do cache de blocos. No fim da entrada os setores
+// excedentes são devolvidos, o fim do arquivo é embutido ou vai para um
+// setor de fragmentos como em uma importação comum, e só então a entrada é
+// inserida no diretório: uma importação interrompida não deixa arquivo
+// parcial.
+// ---------------------------------------------------------------------------
+
+// Maior reserva especulativa de uma vez, em bytes
+#define FLUXO_BLOCO_MAX (64 << 20)
+
+// Leitura da fonte em dois buffers alternados
+typedef struct {
+    int src;
+    size_t tamanho;            // capacidade de cada buffer
+    unsigned char *buffers[2];
+    ssize_t cheios[2];         // bytes lidos em cada buffer (-1 = erro)
+    int prontos[2];            // buffer lido, aguardando gravação
+    int cancelado;             // a gravação falhou: a leitura para
+    int erro;                  // errno da leitura que falhou
+    pthread_mutex_t trava;
+    pthread_cond_t mudou;
+} LeitorFluxo;
+
+static void *thread_leitura_fluxo(void *arg) {
+    LeitorFluxo *l = (LeitorFluxo *)arg;
+    for (int i = 0;; i ^= 1) {
+        pthread_mutex_lock(&l->trava);
+        while (l->prontos[i] && !l->cancelado) {
+            pthread_cond_wait(&l->mudou, &l->trava);
+        }
+        int cancelado = l->cancelado;
+        pthread_mutex_unlock(&l->trava);
+        if (cancelado) {
+            break;
+        }
+
+        ssize_t n = ler_sequencial(l->src, l->buffers[i], l->tamanho);
+
+        pthread_mutex_lock(&l->trava);
+        if (n < 0) l->erro = errno;
+        l->cheios[i] = n;
+        l->prontos[i] = 1;
+        pthread_cond_broadcast(&l->mudou);
+        pthread_mutex_unlock(&l->trava);
+        if (n < (ssize_t)l->tamanho) {
+            break;             // fim da entrada ou erro
+        }
+    }
+    return NULL;
+}
+
+// Setores reservados para o fluxo até aqui
+typedef struct {
+    FileExtent *lista;
+    uint32_t qtd;
+    uint32_t capacidade;
+    uint64_t setores;          // total de setores em lista
+    uint64_t bloco;            // setores da próxima reserva especulativa
+} ReservaFluxo;
+
+// Garante setores para os primeiros 'fim' bytes do fluxo
+static int reservar_fluxo(Volume *vol, ReservaFluxo *r, uint64_t fim) {
+    uint64_t bps = vol->bytes_per_sector;
+    uint64_t necessarios = (fim + bps - 1) / bps;
+    while (r->setores < necessarios) {
+        uint64_t falta = necessarios - r->setores;
+        uint64_t pedido = r->bloco > falta ? r->bloco : falta;
+        if (pedido > vol->br->free_sectors) {
+            pedido = vol->br->free_sectors;
+        }
+        if (pedido < falta) {
+            errno = ENOSPC;
+            return -1;
+        }
+        if (r->bloco < FLUXO_BLOCO_MAX / bps) {
+            r->bloco *= 2;
+        }
+
+        // Primeiro a continuação da última faixa
+        if (r->qtd > 0) {
+            FileExtent *ultima = &r->lista[r->qtd - 1];
+            uint32_t ganho = estender_setores(vol, ultima->start + ultima->count, (uint32_t)pedido);
+            ultima->count += ganho;
+            r->setores += ganho;
+            pedido -= ganho;
+            if (ganho >= falta) {
+                continue;
+            }
+            falta -= ganho;
+        }
+
+        // Depois novas faixas; sem espaço para o bloco inteiro, só o necessário
+        FileExtent *novos;
+        uint32_t n_novos;
+        if (alocar_extents(vol, (uint32_t)pedido, &novos, &n_novos) != 0 &&
+            alocar_extents_confirmando(vol, (uint32_t)falta, &novos, &n_novos) != 0) {
+            errno = ENOSPC;
+            return -1;
+        }
+        if (r->qtd + n_novos > r->capacidade) {
+            uint32_t capacidade = (r->qtd + n_novos) * 2;
+            FileExtent *lista = (FileExtent *)realloc(r->lista, capacidade * sizeof(FileExtent));
+            if (!lista) {
+                for (uint32_t e = 0; e < n_novos; e++) {
+                    liberar_setores(vol, novos[e].start, novos[e].count);
+                }
+                free(novos);
+                errno = ENOMEM;
+                return -1;
+            }
+            r->lista = lista;
+            r->capacidade = capacidade;
+        }
+        for (uint32_t e = 0; e < n_novos; e++) {
+            r->setores += novos[e].count;
+        }
+        r->qtd = anexar_extents(r->lista, r->qtd, novos, n_novos);
+        free(novos);
+    }
+    return 0;
+}
+
+// Mantém os primeiros 'setores' setores da reserva e devolve o restante
+static void cortar_reserva(Volume *vol, ReservaFluxo *r, uint64_t setores) {
+    cortar_extents(vol, r->lista, &r->qtd, setores);
+    r->setores = 0;
+    for (uint32_t e = 0; e < r->qtd; e++) {
+        r->setores += r->lista[e].count;
+    }
+}
+
+// Grava 'len' bytes na posição 'off' do fluxo. Os setores acabaram de ser
+// reservados: cópias em cache são descartadas e a escrita vai direto à imagem.
+static int gravar_fluxo(Volume *vol, const ReservaFluxo *r, uint64_t off, const unsigned char *buf, size_t len) {
+    uint64_t bps = vol->bytes_per_sector;
+    uint64_t base = 0;
+    for (uint32_t e = 0; e < r->qtd && len > 0; e++) {
+        uint64_t tam = (uint64_t)r->lista[e].count * bps;
+        if (off < base + tam) {
+            uint64_t dentro = off - base;
+            size_t n = tam - dentro < len ? (size_t)(tam - dentro) : len;
+            off_t pos = offset_setor(vol->br, r->lista[e].start) + (off_t)dentro;
+            int status = vol->backend == BACKEND_MMAP ? disco_escrever(vol, buf, n, pos, 1)
+                       : cache_contornar(&vol->cache, vol->fd, pos, n, 1) != 0 ? -1
+                       : escrever_em(vol->fd, buf, n, pos);
+            if (status != 0) {
+                return -1;
+            }
+            buf += n;
+            off += n;
+            len -= n;
+        }
+        base += tam;
+    }
+    return 0;
+}
+
+// Lê src até o fim e grava o conteúdo no arquivo 'nome'; a entrada só é
+// inserida quando a leitura termina sem erro
+static int transferir_fluxo(Volume *vol, int src, Importacao *imp, ReservaFluxo *r) {
+    LeitorFluxo l;
+    memset(&l, 0, sizeof(LeitorFluxo));
+    l.src = src;
+    l.tamanho = vol->transfer_size;
+    l.buffers[0] = alocar_buffer_transferencia(vol);
+    l.buffers[1] = alocar_buffer_transferencia(vol);
+    pthread_t leitor;
+    if (!l.buffers[0] || !l.buffers[1]) {
+        free(l.buffers[0]);
+        free(l.buffers[1]);
+        return -1;
+    }
+    pthread_mutex_init(&l.trava, NULL);
+    pthread_cond_init(&l.mudou, NULL);
+    if (pthread_create(&leitor, NULL, thread_leitura_fluxo, &l) != 0) {
+        perror("Erro ao criar thread de leitura");
+        pthread_mutex_destroy(&l.trava);
+        pthread_cond_destroy(&l.mudou);
+        free(l.buffers[0]);
+        free(l.buffers[1]);
+        return -1;
+    }
+
+    uint64_t bps = vol->bytes_per_sector;
+    uint64_t total = 0;
+    int status = 0;
+    int ultimo = 0;
+    for (int i = 0;; i ^= 1) {
+        pthread_mutex_lock(&l.trava);
+        while (!l.prontos[i]) {
+            pthread_cond_wait(&l.mudou, &l.trava);
+        }
+        ssize_t n = l.cheios[i];
+        pthread_mutex_unlock(&l.trava);
+
+        if (n < 0) {
+            errno = l.erro;
+            perror("Erro ao ler arquivo fonte");
+            status = -1;
+            break;
+        }
+        if (total + (uint64_t)n > UINT32_MAX) {
+            printf("Erro: Arquivo grande demais para o sistema de arquivos\n");
+            status = -1;
+            break;
+        }
+        uint64_t inicio = agora_ns();
+        int r_reserva = reservar_fluxo(vol, r, total + (uint64_t)n);
+        ESTAT(ns_alocacao, agora_ns() - inicio);
+        if (r_reserva != 0) {
+            printf("Erro: Espaço insuficiente no disco\n");
+            status = -1;
+            break;
+        }
+        if (n > 0 && gravar_fluxo(vol, r, total, l.buffers[i], (size_t)n) != 0) {
+            perror("Erro ao gravar dados no disco");
+            status = -1;
+            break;
+        }
+        total += (uint64_t)n;
+        if (n > 0) {
+            ultimo = i;
+        }
+        if (n < (ssize_t)l.tamanho) {
+            break;
+        }
+
+        pthread_mutex_lock(&l.trava);
+        l.prontos[i] = 0;
+        pthread_cond_broadcast(&l.mudou);
+        pthread_mutex_unlock(&l.trava);
+    }
+    pthread_mutex_lock(&l.trava);
+    l.cancelado = 1;
+    pthread_cond_broadcast(&l.mudou);
+    pthread_mutex_unlock(&l.trava);
+    pthread_join(leitor, NULL);
+
+    // Fim do arquivo na entrada ou em um setor de fragmentos; o restante
+    // fica nos setores já gravados, sem os excedentes da reserva
+    if (status == 0) {
+        imp->size = total;
+        imp->embutido = vol->empacotar && total > 0 && total <= EMBUTIDO_MAX;
+        uint32_t cauda = imp->embutido ? 0 : (uint32_t)(total % bps);
+        const unsigned char *fim = l.buffers[ultimo] + (total + l.tamanho - 1) % l.tamanho + 1;
+        if (imp->embutido) {
+            memcpy(imp->dados, fim - total, total);
+        } else if (empacotar_cauda(vol, total, cauda) &&
+                   alocar_fragmento(vol, cauda, &imp->cauda_setor, &imp->cauda_offset) == 0) {
+            if (disco_escrever(vol, fim - cauda, cauda,
+                               offset_setor(vol->br, imp->cauda_setor) + imp->cauda_offset, 0) != 0) {
+                perror("Erro ao gravar dados no disco");
+                liberar_fragmento(vol, imp->cauda_setor, imp->cauda_offset, cauda);
+                status = -1;
+            } else {
+                imp->cauda = cauda;
+            }
+        }
+        cortar_reserva(vol, r, imp->embutido ? 0 : (total - imp->cauda + bps - 1) / bps);
+        if (status == 0 && r->qtd > MAX_EXTENTS) {
+            printf("Erro: Arquivo fragmentado demais\n");
+            if (imp->cauda > 0) {
+                liberar_fragmento(vol, imp->cauda_setor, imp->cauda_offset, imp->cauda);
+            }
+            status = -1;
+        }
+    }
+
+    pthread_mutex_destroy(&l.trava);
+    pthread_cond_destroy(&l.mudou);
+    free(l.buffers[0]);
+    free(l.buffers[1]);
+    return status;
+}
+
+// Importa o conteúdo lido de src até o fim como o arquivo 'nome'
+int importar_fluxo(Volume *vol, int src, const char *nome) {
+    if (!volume_montado(vol)) {
+        return -1;
+    }
+    EstatEscopo e;
+    estat_iniciar(&e, &vol->estat[OP_IMPORTACAO], 0);
+
+    // Nome e entrada livre são conferidos antes de consumir a entrada
+    Importacao imp;
+    memset(&imp, 0, sizeof(Importacao));
+    imp.nome = nome;
+    imp.src = -1;
+    montar_chave(nome, imp.chave);
+    if (dirindex_buscar(&vol->nomes, vol->dir, imp.chave) != -1) {
+        printf("Erro: Arquivo já existe no diretório\n");
+        return estat_concluir(&e, -1);
+    }
+    if (vol->nomes.free_count == 0) {
+        printf("Erro: Diretório cheio\n");
+        return estat_concluir(&e, -1);
+    }
+
+    ReservaFluxo r;
+    memset(&r, 0, sizeof(ReservaFluxo));
+    r.bloco = vol->transfer_size / vol->bytes_per_sector;
+    Medicao medicao;
+    medicao_iniciar(&medicao);
+    uint64_t inicio = agora_ns();
+    int status = transferir_fluxo(vol, src, &imp, &r);
+    ESTAT(ns_dados, agora_ns() - inicio);
+    if (status != 0) {
+        cortar_reserva(vol, &r, 0);
+        free(r.lista);
+        return estat_concluir(&e, -1);
+    }
+    medicao_relatar(vol, &medicao, "importação em fluxo", imp.size);
+
+    // inserir_importacao assume a lista e, em caso de erro, devolve os setores
+    imp.extents = r.lista;
+    imp.extent_count = r.qtd;
+    return estat_concluir(&e, inserir_importacao(vol, &imp));
+}
+
+// ---------------------------------------------------------------------------
+// Desfragmentação
+//
+// Os arquivos são percorridos em ordem de posição e cada um é copiado para
+// a primeira faixa livre que o comporte inteiro, quando ela fica antes do
+// arquivo (compactando o espaço livre no fim da área de dados) ou quando o
+// arquivo tem mais de um extent. As passadas alternam a ordem crescente,
+// que desloca os arquivos para o início, e a decrescente, que preenche os
+// buracos restantes com os últimos arquivos e abre uma faixa contígua no
+// fim para os fragmentados. Cada movimentação segue a ordem:
+//
+//   1. cópia dos dados para setores livres, que nenhuma entrada confirmada
+//      referencia;
+//   2. barreira (fdatasync) antes do journal, via barreira_dados;
+//   3. transação com a entrada apontando para a cópia e o bitmap atualizado.
+//
+// Os setores antigos só voltam a ser alocáveis depois dessa transação, de
+// modo que uma queda em qualquer ponto deixa o arquivo íntegro no lugar
+// antigo ou no novo. O trabalho pode ser limitado em bytes ou em tempo; uma
+// nova execução continua de onde o volume está.
+// ---------------------------------------------------------------------------
+
+// Arquivo candidato: entrada do diretório e posição do primeiro extent
+typedef struct {
+    int indice;
+    uint32_t inicio;
+} ArquivoPosicao;
+
+static int comparar_posicoes(const void *a, const void *b) {
+    uint32_t x = ((const ArquivoPosicao *)a)->inicio;
+    uint32_t y = ((const ArquivoPosicao *)b)->inicio;
+    return (x > y) - (x < y);
+}
+
+static int comparar_posicoes_desc(const void *a, const void *b) {
+    return comparar_posicoes(b, a);
+}
+
+// Passadas sem limite de bytes ou tempo terminam quando nada mais se move
+#define DESFRAG_PASSADAS 6
+
+// Copia os setores dos extents para a faixa contígua iniciada em 'destino'
+static int copiar_setores(Volume *vol, const FileExtent *extents, uint32_t qtd, uint32_t destino) {
+    uint64_t bps = vol->bytes_per_sector;
+    off_t saida = offset_setor(vol->br, destino);
+    if (vol->backend == BACKEND_MMAP) {
+        for (uint32_t e = 0; e < qtd; e++) {
+            uint64_t bytes = extents[e].count * bps;
+            memcpy(vol->map + saida, vol->map + offset_setor(vol->br, extents[e].start), bytes);
+            saida += bytes;
+        }
+        return 0;
+    }
+
+    // A origem precisa estar no arquivo e o destino não pode ter cópias em cache
+    for (uint32_t e = 0; e < qtd; e++) {
+        if (cache_contornar(&vol->cache, vol->fd, offset_setor(vol->br, extents[e].start),
+                            extents[e].count * bps, 1) != 0) {
+            return -1;
+        }
+    }
+    uint64_t total = 0;
+    for (uint32_t e = 0; e < qtd; e++) total += extents[e].count * bps;
+    if (cache_contornar(&vol->cache, vol->fd, saida, total, 1) != 0) {
+        return -1;
+    }
+
+    unsigned char *buffer = alocar_buffer_transferencia(vol);
+    if (!buffer) {
+        return -1;
+    }
+    int no_kernel = vol->io_engine == MOTOR_ZERO_COPY;
+    for (uint32_t e = 0; e < qtd; e++) {
+        off_t entrada = offset_setor(vol->br, extents[e].start);
+        uint64_t restante = extents[e].count * bps;
+        while (restante > 0) {
+            size_t len = restante < vol->transfer_size ? (size_t)restante : vol->transfer_size;
+            if (no_kernel) {
+                ssize_t n = copiar_no_kernel(vol, vol->fd, &entrada, vol->fd, &saida, len);
+                if (n > 0) {
+                    restante -= (uint64_t)n;
+                    continue;
+                }
+                if (n < 0) {
+                    free(buffer);
+                    return -1;
+                }
+                no_kernel = 0;
+            }
+            if (ler_em(vol->fd, buffer, len, entrada) != 0 || escrever_em(vol->fd, buffer, len, saida) != 0) {
+                free(buffer);
+                return -1;
+            }
+            entrada += len;
+            saida += len;
+            restante -= len;
+        }
+    }
+    free(buffer);
+    return 0;
+}
+
+// Substitui a lista de extents da entrada i e confirma a transação; os
+// setores de 'antigos' e os blocos de extents anteriores são liberados. Em
+// caso de erro a entrada fica como estava.
+static int trocar_extents(Volume *vol, int i, const FileExtent *lista, uint32_t qtd,
+                          const FileExtent *antigos, uint32_t qtd_antigos) {
+    if (substituir_extents(vol, i, lista, qtd) != 0) {
+        return -1;
+    }
+    for (uint32_t e = 0; e < qtd_antigos; e++) {
+        liberar_setores(vol, antigos[e].start, antigos[e].count);
+    }
+    return sincronizar_volume(vol);
+}
+
+// Limite de uma execução e trabalho feito até aqui
+typedef struct {
+    uint64_t limite_bytes;     // 0 = sem limite
+    uint64_t limite_ms;        // 0 = sem limite
+    uint64_t inicio;           // agora_ns() no começo
+    uint64_t copiados;         // bytes copiados
+    uint32_t movidos;          // arquivos ou extents movidos
+    int esgotado;              // limite atingido
+} Orcamento;
+
+// Reserva o limite para mais 'bytes'; a primeira cópia sempre é permitida
+static int orcamento_permite(Orcamento *o, uint64_t bytes) {
+    if ((o->limite_bytes && o->copiados > 0 && o->copiados + bytes > o->limite_bytes) ||
+        (o->limite_ms && (agora_ns() - o->inicio) / 1000000 >= o->limite_ms)) {
+        o->esgotado = 1;
+        return 0;
+    }
+    return 1;
+}
+
+// Reserva [destino, destino + n) na faixa livre e, com os dados copiados
+// e a barreira marcada, troca os extents do arquivo
+static int mover_para(Volume *vol, FreeExtent *e, uint32_t n, int i, const FileExtent *origem, uint32_t qtd_origem,
+                      FileExtent *lista, uint32_t qtd, Orcamento *o) {
+    uint32_t destino = e->start;
+    if (indice_ocupar(&vol->livres, e, destino, n) != 0) {
+        return -1;
+    }
+    marcar_bitmap(vol, destino, n, 1);
+    if (copiar_setores(vol, origem, qtd_origem, destino) != 0) {
+        perror("Erro ao mover arquivo");
+        liberar_setores(vol, destino, n);
+        return -1;
+    }
+    vol->barreira_dados = 1;
+
+    // Extents vizinhos no disco e no arquivo viram um só
+    uint32_t m = 0;
+    for (uint32_t k = 0; k < qtd; k++) {
+        FileExtent x = lista[k];
+        if (x.start == origem[0].start && qtd_origem == 1) {
+            x.start = destino;
+        }
+        if (m > 0 && lista[m - 1].start + lista[m - 1].count == x.start) {
+            lista[m - 1].count += x.count;
+        } else {
+            lista[m++] = x;
+        }
+    }
+    if (trocar_extents(vol, i, lista, m, origem, qtd_origem) != 0) {
+        perror("Erro ao mover arquivo");
+        liberar_setores(vol, destino, n);
+        return -1;
+    }
+    o->copiados += (uint64_t)n * vol->bytes_per_sector;
+    o->movidos++;
+    return 0;
+}
+
+// Leva o arquivo da entrada i inteiro para a primeira faixa que o comporte,
+// se ela fica antes dele ou se ele está fragmentado; senão, leva cada
+// extent para a primeira faixa livre anterior que o comporte
+static int desfragmentar_arquivo(Volume *vol, int i, Orcamento *o) {
+    FreeIndex *idx = indice_livre(vol);
+    if (!idx) {
+        return -1;
+    }
+    uint64_t bps = vol->bytes_per_sector;
+    FileExtent *extents;
+    uint32_t qtd;
+    if (carregar_extents(vol, &vol->dir[i], &extents, &qtd) != 0) {
+        return -1;
+    }
+    uint32_t n = 0;
+    for (uint32_t k = 0; k < qtd; k++) n += extents[k].count;
+
+    FreeExtent *e = buscar_first_fit(idx->by_start, n);
+    if (n > 0 && e && (e->start < extents[0].start || qtd > 1)) {
+        int status = 0;
+        if (orcamento_permite(o, n * bps)) {
+            FileExtent novo = {e->start, n};
+            status = mover_para(vol, e, n, i, extents, qtd, &novo, 1, o);
+        }
+        free(extents);
+        return status;
+    }
+
+    // Cada movimentação de extent reduz o início de um extent: termina
+    for (uint32_t k = 0; k < qtd && qtd > 1 && !o->esgotado; k++) {
+        e = buscar_first_fit(idx->by_start, extents[k].count);
+        if (!e || e->start >= extents[k].start || !orcamento_permite(o, extents[k].count * bps)) {
+            continue;
+        }
+        FileExtent origem = extents[k];
+        if (mover_para(vol, e, origem.count, i, &origem, 1, extents, qtd, o) != 0) {
+            free(extents);
+            return -1;
+        }
+        free(extents);
+        if (carregar_extents(vol, &vol->dir[i], &extents, &qtd) != 0) {
+            return -1;
+        }
+        k = (uint32_t)-1;
+    }
+    free(extents);
+    return 0;
+}
+
+// Desfragmenta até copiar 'limite_bytes' bytes ou passar de 'limite_ms'
+// milissegundos (0 = sem limite)
+int desfragmentar_volume(Volume *vol, uint64_t limite_bytes, uint64_t limite_ms) {
+    if (!volume_montado(vol) || sincronizar_volume(vol) != 0) {
+        return -1;
+    }
+    Orcamento o = {limite_bytes, limite_ms, agora_ns(), 0, 0, 0};
+    uint32_t maior_antes = vol->br->largest_free_run;
+
+    ArquivoPosicao *arquivos = (ArquivoPosicao *)malloc((vol->dir_entries ? vol->dir_entries : 1) * sizeof(ArquivoPosicao));
+    if (!arquivos) {
+        perror("Erro ao alocar memória para desfragmentação");
+        return -1;
+    }
+    int status = 0;
+    for (int passada = 0; passada < DESFRAG_PASSADAS && status == 0 && !o.esgotado; passada++) {
+        uint32_t total = 0;
+        for (int i = 0; i < vol->dir_entries; i++) {
+            if (vol->dir[i].status == 0x00 && vol->dir[i].extent_count > 0) {
+                arquivos[total].indice = i;
+                arquivos[total].inicio = vol->dir[i].first_sector;
+                total++;
+            }
+        }
+        qsort(arquivos, total, sizeof(ArquivoPosicao), passada % 2 ? comparar_posicoes_desc : comparar_posicoes);
+
+        uint32_t antes = o.movidos;
+        for (uint32_t k = 0; k < total && status == 0 && !o.esgotado; k++) {
+            status = desfragmentar_arquivo(vol, arquivos[k].indice, &o);
+        }
+        if (o.movidos == antes && passada > 0) {
+            break;
+        }
+    }
+    free(arquivos);
+
+    printf("Desfragmentação%s: %u movimentação(ões), %llu KB copiados em %.1f ms\n",
+           o.esgotado ? " interrompida pelo limite" : "", o.movidos,
+           (unsigned long long)(o.copiados / 1024), (agora_ns() - o.inicio) / 1e6);
+    printf("Maior faixa livre: %u setores (antes %u)\n", vol->br->largest_free_run, maior_antes);
+    return status;
+}
+
+// Limite da desfragmentação: "30s" ou "500ms" limitam o tempo; um tamanho
+// (com sufixo K, M ou G) limita os bytes copiados; "0" = sem limite
+void ler_limite_desfragmentacao(const char *texto, uint64_t *bytes, uint64_t *ms) {
+    *bytes = 0;
+    *ms = 0;
+    if (!texto || !*texto) {
+        return;
+    }
+    char *fim;
+    uint64_t valor = strtoull(texto, &fim, 10);
+    if (strcmp(fim, "ms") == 0) {
+        *ms = valor;
+    } else if (strcmp(fim, "s") == 0) {
+        *ms = valor * 1000;
+    } else {
+        *bytes = ler_tamanho(texto);
+    }
+}
+
+// SA_FORMAT=esparso (padrão), reservado ou zerado
+void formato_do_ambiente(FormatParams *params) {
+    const char *valor = getenv("SA_FORMAT");
+    params->area_dados = FORMATO_ESPARSO;
+    if (valor && strcmp(valor, "reservado") == 0) {
+        params->area_dados = FORMATO_RESERVADO;
+    } else if (valor && strcmp(valor, "zerado") == 0) {
+        params->area_dados = FORMATO_ZERADO;
+    }
+}
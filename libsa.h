@@ -0,0 +1,160 @@
+// libsa: núcleo do sistema de arquivos (formatação, montagem, transferências,
+// manutenção e acesso posicional a arquivos abertos)
+//
+//   gcc -O2 -c libsa.c -o libsa.o && ar rcs libsa.a libsa.o
+//   gcc programa.c -o programa -L. -lsa -pthread
+//
+// As funções de volume exibem as mensagens de erro e retornam -1 (ou uma
+// contagem de falhas), como no programa sa. As funções sa_* de arquivos
+// abertos não exibem nada: retornam -1 e indicam a causa em errno. Um volume
+// e seus arquivos abertos não devem ser usados por mais de uma thread ao
+// mesmo tempo.
+
+#ifndef LIBSA_H
+#define LIBSA_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+// Geometria padrão, de acordo com a especificação original
+#define BYTES_PER_SECTOR 512
+#define SECTORS_PER_BLOCK 8
+#define RESERVED_SECTORS 1
+#define DIR_SECTORS 2
+#define BITMAP_SECTORS 1
+#define DATA_SECTORS 196
+#define TOTAL_SECTORS (RESERVED_SECTORS + DIR_SECTORS + BITMAP_SECTORS + DATA_SECTORS)
+#define DIR_CAPACITY 32
+
+// Parâmetros de formatação (0 em qualquer campo = valor padrão)
+typedef struct {
+    uint64_t disk_size;        // tamanho total da imagem em bytes
+    uint32_t bytes_per_sector; // potência de 2 entre 512 e 65536
+    uint32_t sectors_per_block;
+    uint32_t dir_capacity;     // quantidade mínima de entradas do diretório
+    int area_dados;            // FORMATO_ESPARSO, FORMATO_RESERVADO ou FORMATO_ZERADO
+} FormatParams;
+
+// Tratamento da área de dados na formatação
+#define FORMATO_ESPARSO   0    // apenas ftruncate: blocos alocados na primeira escrita
+#define FORMATO_RESERVADO 1    // fallocate: espaço reservado no host, sem escrever zeros
+#define FORMATO_ZERADO    2    // zeros escritos em toda a área de dados
+
+// Formatos de exibição das estatísticas
+#define ESTAT_TEXTO 0
+#define ESTAT_JSON  1
+#define ESTAT_PROM  2
+
+// Políticas de escolha da faixa livre
+#define ALOC_FIRST_FIT 0
+#define ALOC_BEST_FIT  1
+#define ALOC_NEXT_FIT  2
+
+// Intervalo padrão de sincronização (em operações que alteram metadados)
+#define SYNC_INTERVAL_PADRAO 32
+
+// Backends de armazenamento selecionáveis na montagem
+#define BACKEND_STDIO 0        // pread/pwrite, metadados copiados para a memória
+#define BACKEND_MMAP  1        // imagem mapeada; dados acessados no mapeamento
+
+// Motores de transferência de dados (backend stdio)
+#define MOTOR_BUFFER    0      // pread/pwrite por um buffer do processo
+#define MOTOR_ZERO_COPY 1      // copy_file_range, sendfile ou splice no kernel
+#define MOTOR_IO_URING  2      // leituras e escritas assíncronas em fila pelo io_uring
+
+// Operações do io_uring em andamento por transferência
+#define QUEUE_DEPTH_PADRAO 8
+#define QUEUE_DEPTH_MAX 64
+
+// Tamanho das transferências de dados (ajustado para múltiplo do bloco)
+#define TRANSFER_SIZE_PADRAO (1 << 20)
+#define TRANSFER_SIZE_MIN (64 << 10)
+#define TRANSFER_SIZE_MAX (4 << 20)
+
+// Threads de transferência nas importações e exportações em lote
+#define THREADS_MAX 16
+// Arquivos preparados por rodada de transferência paralela
+#define JANELA_PARALELA 64
+
+// Opções usadas ao montar o volume
+typedef struct {
+    int sync_interval;         // sincroniza a cada N operações (0 = apenas sync/desmontagem)
+    int alloc_policy;          // ALOC_FIRST_FIT, ALOC_BEST_FIT ou ALOC_NEXT_FIT
+    size_t transfer_size;      // bytes por leitura/escrita de dados (64 KB a 4 MB)
+    int backend;               // BACKEND_STDIO ou BACKEND_MMAP
+    int io_engine;             // MOTOR_BUFFER, MOTOR_ZERO_COPY ou MOTOR_IO_URING
+    int queue_depth;           // profundidade da fila do io_uring
+    int report;                // exibe vazão e CPU de cada transferência
+    int threads;               // threads de transferência em lote (1 = sequencial)
+    size_t cache_size;         // bytes do cache de blocos (0 = desativado)
+    int punch;                 // devolve ao host os setores liberados
+    int empacotar;             // arquivos pequenos embutidos e caudas em setores de fragmentos
+    int comprimir;             // importações comprimidas em blocos independentes
+} MountOptions;
+
+// Volume montado (conteúdo interno à biblioteca)
+typedef struct Volume Volume;
+
+// Arquivo aberto com sa_abrir
+typedef struct SaArquivo SaArquivo;
+
+// Modos de sa_abrir (combináveis)
+#define SA_LEITURA 0x0         // apenas sa_ler e sa_estado
+#define SA_ESCRITA 0x1         // permite sa_escrever, sa_anexar, sa_truncar e sa_reservar
+#define SA_CRIAR   0x2         // cria o arquivo vazio se não existir (implica SA_ESCRITA)
+#define SA_TRUNCAR 0x4         // descarta o conteúdo ao abrir (implica SA_ESCRITA)
+
+// Informações de um arquivo aberto (sa_estado)
+typedef struct {
+    uint64_t size;             // tamanho em bytes
+    uint32_t extent_count;     // faixas de setores de dados
+    uint32_t sectors;          // setores de dados alocados, inclusive os reservados além do fim
+    uint32_t first_sector;     // início do primeiro extent (0 = nenhum)
+    unsigned char attributes;  // atributos da entrada do diretório
+} SaEstado;
+
+// Volume
+Volume *volume_criar(void);
+void volume_destruir(Volume *vol);
+int formatar_disco(const char *disk_filename, const FormatParams *params);
+void formato_do_ambiente(FormatParams *params);
+uint64_t ler_tamanho(const char *texto);
+void opcoes_padrao(MountOptions *opts);
+void opcoes_do_ambiente(MountOptions *opts);
+int montar_volume(Volume *vol, const char *disk_filename, const MountOptions *opts);
+int sincronizar_volume(Volume *vol);
+void desmontar_volume(Volume *vol);
+int volume_montado(const Volume *vol);
+
+// Arquivos inteiros
+int copiar_para_sa(Volume *vol, const char *source_filename);
+int copiar_para_disco(Volume *vol, const char *target_filename);
+int importar_arquivos(Volume *vol, char **nomes, int quantidade);
+int exportar_arquivos(Volume *vol, char **nomes, int quantidade);
+int remover_arquivo(Volume *vol, const char *filename);
+int listar_arquivos(Volume *vol);
+int anexar_arquivo(Volume *vol, const char *source_filename, uint64_t reserva);
+int importar_fluxo(Volume *vol, int src, const char *nome);
+
+// Manutenção e relatórios
+int aparar_volume(Volume *vol);
+int desfragmentar_volume(Volume *vol, uint64_t limite_bytes, uint64_t limite_ms);
+void ler_limite_desfragmentacao(const char *texto, uint64_t *bytes, uint64_t *ms);
+int exibir_espaco(Volume *vol);
+void exibir_cache(Volume *vol);
+void exibir_disco(Volume *vol);
+int exibir_estatisticas(Volume *vol, int formato);
+int formato_estatisticas(const char *nome);
+
+// Arquivos abertos: leitura e escrita em qualquer posição
+SaArquivo *sa_abrir(Volume *vol, const char *nome, int modo);
+int sa_fechar(SaArquivo *arq);
+ssize_t sa_ler(SaArquivo *arq, void *buf, size_t len, uint64_t off);
+ssize_t sa_escrever(SaArquivo *arq, const void *buf, size_t len, uint64_t off);
+ssize_t sa_anexar(SaArquivo *arq, const void *buf, size_t len);
+int sa_truncar(SaArquivo *arq, uint64_t tamanho);
+int sa_reservar(SaArquivo *arq, uint64_t tamanho);
+int sa_estado(SaArquivo *arq, SaEstado *estado);
+
+#endif
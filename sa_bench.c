@@ -0,0 +1,641 @@
+// sa_bench: bancada de desempenho do sistema de arquivos
+//
+// Formata imagens de tamanho configurável e executa cargas parametrizadas
+// sobre cada operação, com conteúdo, tamanhos e ordem de remoção gerados a
+// partir de uma semente fixa. Para cada operação exibe vazão, latência p50/p99
+// e chamadas de sistema por operação, em tabela e em JSON.
+//
+//   gcc -O2 sa_bench.c -o sa_bench -pthread
+//   ./sa_bench [-s tamanho] [-e entradas] [-r repetições] [-S semente]
+//              [-c cargas] [-j saida.json] [-d diretório]
+//
+// Motor de E/S, backend, política de alocação, threads e cache são os do
+// sa, escolhidos pelas variáveis SA_*, o que permite comparar versões e
+// configurações com a mesma semente.
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+
+// ---------------------------------------------------------------------------
+// Contagem de chamadas de sistema
+//
+// As chamadas feitas por libsa.c passam pelas macros abaixo, que incrementam o
+// contador da categoria e chamam a função original (uma macro não se expande
+// dentro da própria definição). Os cabeçalhos já foram incluídos, então as
+// declarações não são afetadas.
+// ---------------------------------------------------------------------------
+
+enum {
+    SC_LEITURA,    // read, pread, preadv
+    SC_ESCRITA,    // write, pwrite, pwritev
+    SC_SYNC,       // fdatasync, fsync
+    SC_COPIA,      // copy_file_range, sendfile, splice
+    SC_URING,      // io_uring_setup/enter/register
+    SC_OUTRAS,     // open, close, lseek, fstat, ftruncate, fallocate, mmap, munmap
+    SC_TOTAL
+};
+
+static const char *nomes_chamadas[SC_TOTAL] = {"leitura", "escrita", "sync", "copia", "uring", "outras"};
+
+static uint64_t bench_chamadas[SC_TOTAL];
+
+static inline void bench_contar(int categoria) {
+    __atomic_fetch_add(&bench_chamadas[categoria], 1, __ATOMIC_RELAXED);
+}
+
+#define read(...)            (bench_contar(SC_LEITURA), read(__VA_ARGS__))
+#define pread(...)           (bench_contar(SC_LEITURA), pread(__VA_ARGS__))
+#define preadv(...)          (bench_contar(SC_LEITURA), preadv(__VA_ARGS__))
+#define write(...)           (bench_contar(SC_ESCRITA), write(__VA_ARGS__))
+#define pwrite(...)          (bench_contar(SC_ESCRITA), pwrite(__VA_ARGS__))
+#define pwritev(...)         (bench_contar(SC_ESCRITA), pwritev(__VA_ARGS__))
+#define fdatasync(...)       (bench_contar(SC_SYNC), fdatasync(__VA_ARGS__))
+#define fsync(...)           (bench_contar(SC_SYNC), fsync(__VA_ARGS__))
+#define copy_file_range(...) (bench_contar(SC_COPIA), copy_file_range(__VA_ARGS__))
+#define sendfile(...)        (bench_contar(SC_COPIA), sendfile(__VA_ARGS__))
+#define splice(...)          (bench_contar(SC_COPIA), splice(__VA_ARGS__))
+#define syscall(...)         (bench_contar(SC_URING), syscall(__VA_ARGS__))
+#define open(...)            (bench_contar(SC_OUTRAS), open(__VA_ARGS__))
+#define close(...)           (bench_contar(SC_OUTRAS), close(__VA_ARGS__))
+#define lseek(...)           (bench_contar(SC_OUTRAS), lseek(__VA_ARGS__))
+#define fstat(...)           (bench_contar(SC_OUTRAS), fstat(__VA_ARGS__))
+#define ftruncate(...)       (bench_contar(SC_OUTRAS), ftruncate(__VA_ARGS__))
+#define fallocate(...)       (bench_contar(SC_OUTRAS), fallocate(__VA_ARGS__))
+#define mmap(...)            (bench_contar(SC_OUTRAS), mmap(__VA_ARGS__))
+#define munmap(...)          (bench_contar(SC_OUTRAS), munmap(__VA_ARGS__))
+
+#include "libsa.c"
+
+#undef read
+#undef write
+#undef open
+#undef close
+#undef fstat
+
+// ---------------------------------------------------------------------------
+// Amostras
+// ---------------------------------------------------------------------------
+
+#define AMOSTRAS_MAX 64
+
+// Cargas disponíveis (-c)
+#define CARGA_TAMANHOS      0x1    // import/export/rm de 1 byte até o volume inteiro
+#define CARGA_LISTA         0x2    // diretório cheio e listagens
+#define CARGA_ROTATIVIDADE  0x4    // remoção e reimportação aleatórias
+#define CARGA_FRAGMENTACAO  0x8    // sequência mista que fragmenta a área livre
+
+// Medições de uma operação em uma carga e tamanho
+typedef struct {
+    const char *carga;
+    const char *operacao;
+    uint64_t tamanho;          // tamanho dos arquivos (0 = variado)
+    double *lat_us;            // latência de cada operação
+    uint32_t n, cap;
+    uint32_t falhas;
+    uint64_t bytes;            // bytes transferidos pelas operações bem-sucedidas
+    double total_us;           // soma das latências
+    uint64_t chamadas[SC_TOTAL];
+} Amostra;
+
+typedef struct {
+    uint64_t tamanho_volume;   // bytes da imagem formatada
+    uint32_t entradas;         // capacidade do diretório
+    uint32_t repeticoes;       // operações por tamanho (cargas pequenas)
+    uint64_t semente;
+    int cargas;                // máscara CARGA_*
+    const char *json;          // arquivo JSON ("-" = saída padrão, NULL = nenhum)
+    char dir[512];             // diretório de trabalho
+    int dir_criado;            // dir criado pela bancada (removido ao final)
+    MountOptions opts;
+    FILE *rel;                 // saída do relatório (stdout original)
+    uint64_t rng;              // estado do gerador pseudoaleatório
+    Amostra amostras[AMOSTRAS_MAX];
+    int quantidade;
+    double extents_por_arquivo;// resultado da carga de fragmentação
+    uint32_t faixas_livres;
+} Bancada;
+
+// Marca de início de uma operação
+typedef struct {
+    struct timespec t;
+    uint64_t chamadas[SC_TOTAL];
+} Marca;
+
+static Amostra *amostra(Bancada *b, const char *carga, const char *operacao, uint64_t tamanho) {
+    for (int i = 0; i < b->quantidade; i++) {
+        Amostra *a = &b->amostras[i];
+        if (a->carga == carga && a->operacao == operacao && a->tamanho == tamanho) {
+            return a;
+        }
+    }
+    if (b->quantidade == AMOSTRAS_MAX) {
+        fprintf(stderr, "sa_bench: amostras demais\n");
+        exit(EXIT_FAILURE);
+    }
+    Amostra *a = &b->amostras[b->quantidade++];
+    memset(a, 0, sizeof(Amostra));
+    a->carga = carga;
+    a->operacao = operacao;
+    a->tamanho = tamanho;
+    return a;
+}
+
+static void marcar(Marca *m) {
+    for (int i = 0; i < SC_TOTAL; i++) {
+        m->chamadas[i] = __atomic_load_n(&bench_chamadas[i], __ATOMIC_RELAXED);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &m->t);
+}
+
+// Registra a operação iniciada em 'm'; 'ok' = 0 conta como falha
+static void registrar(Amostra *a, const Marca *m, uint64_t bytes, int ok) {
+    struct timespec fim;
+    clock_gettime(CLOCK_MONOTONIC, &fim);
+    double us = (fim.tv_sec - m->t.tv_sec) * 1e6 + (fim.tv_nsec - m->t.tv_nsec) / 1e3;
+    for (int i = 0; i < SC_TOTAL; i++) {
+        a->chamadas[i] += __atomic_load_n(&bench_chamadas[i], __ATOMIC_RELAXED) - m->chamadas[i];
+    }
+    if (!ok) {
+        a->falhas++;
+        return;
+    }
+    if (a->n == a->cap) {
+        a->cap = a->cap ? a->cap * 2 : 64;
+        a->lat_us = (double *)realloc(a->lat_us, a->cap * sizeof(double));
+        if (!a->lat_us) {
+            perror("sa_bench");
+            exit(EXIT_FAILURE);
+        }
+    }
+    a->lat_us[a->n++] = us;
+    a->total_us += us;
+    a->bytes += bytes;
+}
+
+static int comparar_double(const void *x, const void *y) {
+    double a = *(const double *)x, b = *(const double *)y;
+    return a < b ? -1 : a > b;
+}
+
+// Percentil p (0..1) pelo método do posto mais próximo; lat_us já ordenado
+static double percentil(const Amostra *a, double p) {
+    if (a->n == 0) {
+        return 0;
+    }
+    uint32_t i = (uint32_t)(p * a->n + 0.999999);
+    return a->lat_us[i ? i - 1 : 0];
+}
+
+static double vazao_mbs(const Amostra *a) {
+    return a->total_us > 0 ? (a->bytes / 1048576.0) / (a->total_us / 1e6) : 0;
+}
+
+// ---------------------------------------------------------------------------
+// Arquivos e volumes de teste
+// ---------------------------------------------------------------------------
+
+// xorshift64*: sequência determinada pela semente
+static uint64_t aleatorio(Bancada *b) {
+    b->rng ^= b->rng >> 12;
+    b->rng ^= b->rng << 25;
+    b->rng ^= b->rng >> 27;
+    return b->rng * 0x2545F4914F6CDD1DULL;
+}
+
+// Tamanho com distribuição log-uniforme em [min, max]
+static uint64_t tamanho_aleatorio(Bancada *b, uint64_t min, uint64_t max) {
+    int bits_min = 63 - __builtin_clzll(min);
+    int bits_max = 63 - __builtin_clzll(max);
+    int bits = bits_min + (int)(aleatorio(b) % (uint64_t)(bits_max - bits_min + 1));
+    uint64_t t = (1ULL << bits) + aleatorio(b) % (1ULL << bits);
+    return t < min ? min : t > max ? max : t;
+}
+
+// Cria o arquivo fonte 'nome' com 'tamanho' bytes pseudoaleatórios
+static void gerar_arquivo(Bancada *b, const char *nome, uint64_t tamanho) {
+    FILE *f = fopen(nome, "wb");
+    if (!f) {
+        perror("sa_bench: Erro ao criar arquivo de teste");
+        exit(EXIT_FAILURE);
+    }
+    static uint64_t buf[1 << 17];
+    while (tamanho > 0) {
+        size_t n = tamanho < sizeof(buf) ? (size_t)tamanho : sizeof(buf);
+        for (size_t i = 0; i < (n + 7) / 8; i++) {
+            buf[i] = aleatorio(b);
+        }
+        if (fwrite(buf, 1, n, f) != n) {
+            perror("sa_bench: Erro ao gravar arquivo de teste");
+            exit(EXIT_FAILURE);
+        }
+        tamanho -= n;
+    }
+    fclose(f);
+}
+
+// Formata a imagem da bancada e a monta em 'vol'
+static void novo_volume(Bancada *b, Volume *vol) {
+    FormatParams params;
+    memset(&params, 0, sizeof(FormatParams));
+    params.disk_size = b->tamanho_volume;
+    params.dir_capacity = b->entradas;
+    if (formatar_disco("bench.img", &params) != 0 || montar_volume(vol, "bench.img", &b->opts) != 0) {
+        fprintf(stderr, "sa_bench: Erro ao preparar o volume de teste\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+static uint64_t bytes_livres(const Volume *vol) {
+    uint64_t livres = (uint64_t)vol->br->free_sectors * vol->bytes_per_sector;
+    return livres > UINT32_MAX ? UINT32_MAX : livres;
+}
+
+// Importa 'nome' medindo a operação em 'a'
+static int medir_importacao(Amostra *a, Volume *vol, const char *nome, uint64_t tamanho) {
+    Marca m;
+    marcar(&m);
+    int ok = copiar_para_sa(vol, nome) == 0;
+    registrar(a, &m, tamanho, ok);
+    return ok;
+}
+
+// Exporta 'nome' para o subdiretório "saida", medindo a operação em 'a'
+static int medir_exportacao(Amostra *a, Volume *vol, const char *nome, uint64_t tamanho) {
+    if (chdir("saida") != 0) {
+        return 0;
+    }
+    Marca m;
+    marcar(&m);
+    int ok = copiar_para_disco(vol, nome) == 0;
+    registrar(a, &m, tamanho, ok);
+    unlink(nome);
+    return chdir("..") == 0 && ok;
+}
+
+static int medir_remocao(Amostra *a, Volume *vol, const char *nome) {
+    Marca m;
+    marcar(&m);
+    int ok = remover_arquivo(vol, nome) == 0;
+    registrar(a, &m, 0, ok);
+    return ok;
+}
+
+// ---------------------------------------------------------------------------
+// Cargas
+// ---------------------------------------------------------------------------
+
+// Importa, exporta e remove arquivos de 1 byte até o espaço livre inteiro
+static void carga_tamanhos(Bancada *b) {
+    Volume vol;
+    novo_volume(b, &vol);
+    uint64_t livre = bytes_livres(&vol);
+
+    uint64_t tamanhos[16];
+    int n = 0;
+    for (uint64_t t = 1; t < livre && n < 15; t = t == 1 ? 4096 : t * 16) {
+        tamanhos[n++] = t;
+    }
+    tamanhos[n++] = livre;
+
+    for (int i = 0; i < n; i++) {
+        uint64_t t = tamanhos[i];
+        uint32_t reps = t >= (16 << 20) ? 3 : b->repeticoes;
+        gerar_arquivo(b, "t.dat", t);
+        for (uint32_t r = 0; r < reps; r++) {
+            if (!medir_importacao(amostra(b, "tamanhos", "import", t), &vol, "t.dat", t)) {
+                break;
+            }
+            medir_exportacao(amostra(b, "tamanhos", "export", t), &vol, "t.dat", t);
+            medir_remocao(amostra(b, "tamanhos", "rm", t), &vol, "t.dat");
+        }
+        unlink("t.dat");
+    }
+    desmontar_volume(&vol);
+}
+
+// Enche o diretório com arquivos pequenos e mede a listagem completa
+static void carga_lista(Bancada *b) {
+    Volume vol;
+    novo_volume(b, &vol);
+    char nome[32];
+    uint32_t total = (uint32_t)vol.dir_entries;
+    for (uint32_t i = 0; i < total; i++) {
+        snprintf(nome, sizeof(nome), "l%05u.dat", i);
+        uint64_t t = tamanho_aleatorio(b, 1, 4096);
+        gerar_arquivo(b, nome, t);
+        medir_importacao(amostra(b, "lista", "import", 0), &vol, nome, t);
+        unlink(nome);
+    }
+    for (uint32_t r = 0; r < b->repeticoes; r++) {
+        Marca m;
+        marcar(&m);
+        int ok = listar_arquivos(&vol) == 0;
+        registrar(amostra(b, "lista", "ls", 0), &m, 0, ok);
+    }
+    desmontar_volume(&vol);
+}
+
+// Remove e reimporta arquivos sorteados de um conjunto fixo
+static void carga_rotatividade(Bancada *b) {
+    Volume vol;
+    novo_volume(b, &vol);
+    uint32_t n = (uint32_t)vol.dir_entries < 128 ? (uint32_t)vol.dir_entries : 128;
+    uint64_t *tamanhos = (uint64_t *)calloc(n, sizeof(uint64_t));
+    char nome[32];
+    for (uint32_t i = 0; i < n; i++) {
+        snprintf(nome, sizeof(nome), "r%05u.dat", i);
+        tamanhos[i] = tamanho_aleatorio(b, 1, 256 << 10);
+        gerar_arquivo(b, nome, tamanhos[i]);
+        copiar_para_sa(&vol, nome);
+    }
+    for (uint32_t r = 0; r < b->repeticoes * 10; r++) {
+        uint32_t i = (uint32_t)(aleatorio(b) % n);
+        snprintf(nome, sizeof(nome), "r%05u.dat", i);
+        medir_remocao(amostra(b, "rotatividade", "rm", 0), &vol, nome);
+        medir_importacao(amostra(b, "rotatividade", "import", 0), &vol, nome, tamanhos[i]);
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        snprintf(nome, sizeof(nome), "r%05u.dat", i);
+        unlink(nome);
+    }
+    free(tamanhos);
+    desmontar_volume(&vol);
+}
+
+// Enche o volume com tamanhos variados, remove metade ao acaso e importa
+// arquivos maiores nos buracos, até faltar espaço
+static void carga_fragmentacao(Bancada *b) {
+    Volume vol;
+    novo_volume(b, &vol);
+    uint32_t max = (uint32_t)vol.dir_entries;
+    unsigned char *presente = (unsigned char *)calloc(max, 1);
+    uint64_t *tamanhos = (uint64_t *)calloc(max, sizeof(uint64_t));
+    char nome[32];
+
+    // Fase 1: até 3/4 do diretório ou 90% do volume
+    uint64_t limite = bytes_livres(&vol) / 10;
+    uint32_t n = 0;
+    while (n < max * 3 / 4) {
+        uint64_t t = tamanho_aleatorio(b, 512, 1 << 20);
+        if (bytes_livres(&vol) < limite + t) break;
+        snprintf(nome, sizeof(nome), "g%05u.dat", n);
+        gerar_arquivo(b, nome, t);
+        if (!medir_importacao(amostra(b, "fragmentacao", "import", 0), &vol, nome, t)) break;
+        presente[n] = 1;
+        tamanhos[n++] = t;
+    }
+
+    // Fase 2: remove metade ao acaso
+    for (uint32_t i = 0; i < n; i++) {
+        if (aleatorio(b) & 1) {
+            snprintf(nome, sizeof(nome), "g%05u.dat", i);
+            medir_remocao(amostra(b, "fragmentacao", "rm", 0), &vol, nome);
+            presente[i] = 0;
+        }
+    }
+
+    // Fase 3: arquivos de 1 a 4 MB nas faixas livres, exportados em seguida
+    uint32_t m = n;
+    while (m < max) {
+        uint64_t t = tamanho_aleatorio(b, 1 << 20, 4 << 20);
+        if (bytes_livres(&vol) < t + (t >> 4)) break;
+        snprintf(nome, sizeof(nome), "g%05u.dat", m);
+        gerar_arquivo(b, nome, t);
+        if (!medir_importacao(amostra(b, "fragmentacao", "import grande", 0), &vol, nome, t)) break;
+        presente[m] = 1;
+        tamanhos[m++] = t;
+    }
+    for (uint32_t i = 0; i < m; i++) {
+        if (presente[i]) {
+            snprintf(nome, sizeof(nome), "g%05u.dat", i);
+            medir_exportacao(amostra(b, "fragmentacao", "export", 0), &vol, nome, tamanhos[i]);
+        }
+    }
+
+    // Extents por arquivo e faixas livres ao final
+    uint64_t extents = 0, arquivos = 0;
+    for (int i = 0; i < vol.dir_entries; i++) {
+        if (vol.dir[i].status == 0x00 && vol.dir[i].filename[0] != '\0') {
+            extents += vol.dir[i].extent_count;
+            arquivos++;
+        }
+    }
+    b->extents_por_arquivo = arquivos ? (double)extents / arquivos : 0;
+    b->faixas_livres = indice_livre(&vol)->extents;
+
+    for (uint32_t i = 0; i < m; i++) {
+        snprintf(nome, sizeof(nome), "g%05u.dat", i);
+        unlink(nome);
+    }
+    free(presente);
+    free(tamanhos);
+    desmontar_volume(&vol);
+}
+
+// ---------------------------------------------------------------------------
+// Relatório
+// ---------------------------------------------------------------------------
+
+static const char *nome_motor(const MountOptions *o) {
+    return o->backend == BACKEND_MMAP ? "mmap"
+         : o->io_engine == MOTOR_ZERO_COPY ? "zerocopy"
+         : o->io_engine == MOTOR_IO_URING ? "uring" : "buffer";
+}
+
+static const char *nome_alocacao(const MountOptions *o) {
+    return o->alloc_policy == ALOC_BEST_FIT ? "best" : o->alloc_policy == ALOC_NEXT_FIT ? "next" : "first";
+}
+
+static void formatar_bytes(char *texto, size_t n, uint64_t bytes) {
+    if (bytes == 0) {
+        snprintf(texto, n, "variado");
+    } else if (bytes >= (1 << 20) && bytes % (1 << 20) == 0) {
+        snprintf(texto, n, "%lluM", (unsigned long long)(bytes >> 20));
+    } else if (bytes >= 1024 && bytes % 1024 == 0) {
+        snprintf(texto, n, "%lluK", (unsigned long long)(bytes >> 10));
+    } else {
+        snprintf(texto, n, "%llu", (unsigned long long)bytes);
+    }
+}
+
+static void exibir_tabela(Bancada *b) {
+    FILE *f = b->rel;
+    fprintf(f, "sa_bench: volume %llu MB, %u entradas, semente %llu\n",
+            (unsigned long long)(b->tamanho_volume >> 20), b->entradas, (unsigned long long)b->semente);
+    fprintf(f, "motor %s, alocação %s, threads %d, cache %zu KB, transferência %zu KB\n\n",
+            nome_motor(&b->opts), nome_alocacao(&b->opts), b->opts.threads,
+            b->opts.backend == BACKEND_STDIO ? b->opts.cache_size / 1024 : 0, b->opts.transfer_size / 1024);
+    // Larguras em bytes: "operação" e "µs" têm caracteres de dois bytes
+    fprintf(f, "%-13s %-16s %9s %6s %5s %9s %11s %11s   chamadas/op (leit escr sync cópia uring outras)\n",
+            "carga", "operação", "tamanho", "ops", "falha", "MB/s", "p50 µs", "p99 µs");
+    for (int i = 0; i < b->quantidade; i++) {
+        Amostra *a = &b->amostras[i];
+        char tam[32], vazao[32];
+        formatar_bytes(tam, sizeof(tam), a->tamanho);
+        if (a->bytes > 0) {
+            snprintf(vazao, sizeof(vazao), "%.1f", vazao_mbs(a));
+        } else {
+            snprintf(vazao, sizeof(vazao), "-");
+        }
+        uint32_t ops = a->n + a->falhas;
+        fprintf(f, "%-13s %-14s %9s %6u %5u %9s %10.1f %10.1f  ", a->carga, a->operacao, tam,
+                a->n, a->falhas, vazao, percentil(a, 0.50), percentil(a, 0.99));
+        for (int c = 0; c < SC_TOTAL; c++) {
+            fprintf(f, " %.1f", ops ? (double)a->chamadas[c] / ops : 0.0);
+        }
+        fprintf(f, "\n");
+    }
+    if (b->cargas & CARGA_FRAGMENTACAO) {
+        fprintf(f, "\nFragmentação final: %.2f extents por arquivo, %u faixas livres\n",
+                b->extents_por_arquivo, b->faixas_livres);
+    }
+}
+
+static void gravar_json(Bancada *b) {
+    FILE *f = strcmp(b->json, "-") == 0 ? b->rel : fopen(b->json, "w");
+    if (!f) {
+        perror("sa_bench: Erro ao criar arquivo JSON");
+        return;
+    }
+    fprintf(f, "{\n  \"volume\": %llu,\n  \"entradas\": %u,\n  \"semente\": %llu,\n",
+            (unsigned long long)b->tamanho_volume, b->entradas, (unsigned long long)b->semente);
+    fprintf(f, "  \"motor\": \"%s\",\n  \"alocacao\": \"%s\",\n  \"threads\": %d,\n",
+            nome_motor(&b->opts), nome_alocacao(&b->opts), b->opts.threads);
+    fprintf(f, "  \"cache\": %zu,\n  \"transferencia\": %zu,\n  \"queue_depth\": %d,\n",
+            b->opts.backend == BACKEND_STDIO ? b->opts.cache_size : 0, b->opts.transfer_size, b->opts.queue_depth);
+    if (b->cargas & CARGA_FRAGMENTACAO) {
+        fprintf(f, "  \"fragmentacao\": {\"extents_por_arquivo\": %.3f, \"faixas_livres\": %u},\n",
+                b->extents_por_arquivo, b->faixas_livres);
+    }
+    fprintf(f, "  \"resultados\": [\n");
+    for (int i = 0; i < b->quantidade; i++) {
+        Amostra *a = &b->amostras[i];
+        fprintf(f, "    {\"carga\": \"%s\", \"operacao\": \"%s\", \"tamanho\": %llu, \"ops\": %u, \"falhas\": %u, "
+                   "\"bytes\": %llu, \"mb_s\": %.3f, \"p50_us\": %.3f, \"p99_us\": %.3f, \"chamadas\": {",
+                a->carga, a->operacao, (unsigned long long)a->tamanho, a->n, a->falhas,
+                (unsigned long long)a->bytes, vazao_mbs(a), percentil(a, 0.50), percentil(a, 0.99));
+        for (int c = 0; c < SC_TOTAL; c++) {
+            fprintf(f, "%s\"%s\": %llu", c ? ", " : "", nomes_chamadas[c], (unsigned long long)a->chamadas[c]);
+        }
+        fprintf(f, "}}%s\n", i + 1 < b->quantidade ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+    if (f != b->rel) {
+        fclose(f);
+    }
+}
+
+// ---------------------------------------------------------------------------
+
+static void uso(const char *programa) {
+    fprintf(stderr, "Uso: %s [-s tamanho] [-e entradas] [-r repetições] [-S semente]\n", programa);
+    fprintf(stderr, "          [-c tamanhos,lista,rotatividade,fragmentacao] [-j saida.json|-] [-d diretório]\n");
+}
+
+static int ler_cargas(const char *texto) {
+    char copia[256];
+    snprintf(copia, sizeof(copia), "%s", texto);
+    int cargas = 0;
+    for (char *c = strtok(copia, ","); c; c = strtok(NULL, ",")) {
+        if (strcmp(c, "tamanhos") == 0) cargas |= CARGA_TAMANHOS;
+        else if (strcmp(c, "lista") == 0) cargas |= CARGA_LISTA;
+        else if (strcmp(c, "rotatividade") == 0) cargas |= CARGA_ROTATIVIDADE;
+        else if (strcmp(c, "fragmentacao") == 0) cargas |= CARGA_FRAGMENTACAO;
+        else return -1;
+    }
+    return cargas;
+}
+
+int main(int argc, char **argv) {
+    static Bancada b;
+    b.tamanho_volume = 64 << 20;
+    b.entradas = 256;
+    b.repeticoes = 20;
+    b.semente = 1;
+    b.cargas = CARGA_TAMANHOS | CARGA_LISTA | CARGA_ROTATIVIDADE | CARGA_FRAGMENTACAO;
+    opcoes_padrao(&b.opts);
+    opcoes_do_ambiente(&b.opts);
+
+    int c;
+    while ((c = getopt(argc, argv, "s:e:r:S:c:j:d:")) != -1) {
+        switch (c) {
+            case 's': b.tamanho_volume = ler_tamanho(optarg); break;
+            case 'e': b.entradas = (uint32_t)ler_tamanho(optarg); break;
+            case 'r': b.repeticoes = (uint32_t)atoi(optarg); break;
+            case 'S': b.semente = strtoull(optarg, NULL, 0); break;
+            case 'c': b.cargas = ler_cargas(optarg); break;
+            case 'j': b.json = optarg; break;
+            case 'd': snprintf(b.dir, sizeof(b.dir), "%s", optarg); break;
+            default: uso(argv[0]); return EXIT_FAILURE;
+        }
+    }
+    if (b.cargas <= 0 || b.repeticoes == 0 || b.tamanho_volume < (1 << 20)) {
+        uso(argv[0]);
+        return EXIT_FAILURE;
+    }
+    b.rng = b.semente ? b.semente : 1;
+
+    if (b.dir[0] == '\0') {
+        snprintf(b.dir, sizeof(b.dir), "/tmp/sa_bench.XXXXXX");
+        if (!mkdtemp(b.dir)) {
+            perror("sa_bench: Erro ao criar diretório de trabalho");
+            return EXIT_FAILURE;
+        }
+        b.dir_criado = 1;
+    }
+    if (chdir(b.dir) != 0 || (mkdir("saida", 0755) != 0 && errno != EEXIST)) {
+        perror("sa_bench: Erro ao preparar diretório de trabalho");
+        return EXIT_FAILURE;
+    }
+
+    // As mensagens das operações vão para /dev/null; o relatório, para a
+    // saída padrão original
+    fflush(stdout);
+    b.rel = fdopen(dup(STDOUT_FILENO), "w");
+    int nulo = open("/dev/null", O_WRONLY);
+    if (!b.rel || nulo < 0 || dup2(nulo, STDOUT_FILENO) < 0) {
+        perror("sa_bench: Erro ao redirecionar a saída");
+        return EXIT_FAILURE;
+    }
+    close(nulo);
+
+    if (b.cargas & CARGA_TAMANHOS) carga_tamanhos(&b);
+    if (b.cargas & CARGA_LISTA) carga_lista(&b);
+    if (b.cargas & CARGA_ROTATIVIDADE) carga_rotatividade(&b);
+    if (b.cargas & CARGA_FRAGMENTACAO) carga_fragmentacao(&b);
+    fflush(stdout);
+
+    for (int i = 0; i < b.quantidade; i++) {
+        qsort(b.amostras[i].lat_us, b.amostras[i].n, sizeof(double), comparar_double);
+    }
+    if (!b.json || strcmp(b.json, "-") != 0) {
+        exibir_tabela(&b);
+    }
+    if (b.json) {
+        gravar_json(&b);
+    }
+    fclose(b.rel);
+
+    unlink("bench.img");
+    rmdir("saida");
+    if (b.dir_criado) {
+        if (chdir("/") == 0) rmdir(b.dir);
+    }
+    for (int i = 0; i < b.quantidade; i++) {
+        free(b.amostras[i].lat_us);
+    }
+    return EXIT_SUCCESS;
+}